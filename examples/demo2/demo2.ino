@@ -18,9 +18,17 @@
 // bounce around the two menus using the '<' and '>' keys.
 // Other teachings include using PROGMEM to store the menu text in FLASH to
 // save SRAM memory, and demonstrate menu keys are case insensitive.
+// The 'I' entry waits for a number without blocking loop(), see async
+// callbacks in SerialMenu.hpp.
+// The sub-menu's moves share one foo() callback, which gets the move chosen
+// from the entry's context value.
+// The menus are declared as types, so each one links to the other with
+// SerialMenu::open<>() and their sizes are known at compile time.
 ///////////////////////////////////////////////////////////////////////////////
 #define DEMOCOPYRIGHT "SerialMenu demo2 - Copyright (c) 2019 Dan Truong"
 
+#define SERIALMENU_ENABLE_ASYNC_CALLBACKS true
+#define SERIALMENU_ENABLE_CONTEXT_CALLBACKS true
 #include <SerialMenu.hpp>
 const SerialMenu& menu = SerialMenu::get();
 
@@ -28,17 +36,15 @@ const SerialMenu& menu = SerialMenu::get();
 // Main menu
 ///////////////////////////////////////////////////////////////////////////////
 
-// Forward declarations for the sub-menu referenced before it is defined.
-extern const SerialMenuEntry subMenu[];
-extern const uint8_t subMenuSize;
+// Declaration of the sub-menu linked to before it is defined.
+struct SubMenu;
 
 // Define the main menu
-const SerialMenuEntry mainMenu[] = {
+SERIALMENU_MENU(MainMenu) = {
   {"1 - Print 1",        false, '1', [](){ Serial.println("One"); } },
   {"M - Redisplay Menu", false, 'm', [](){ menu.show(); } },
-  {"> - Sub-menu",       false, '>', [](){ menu.load(subMenu, subMenuSize); menu.show();} }
+  {"> - Sub-menu",       false, '>', SerialMenu::open<SubMenu> }
 };
-constexpr uint8_t mainMenuSize = GET_MENU_SIZE(mainMenu);
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -47,9 +53,17 @@ constexpr uint8_t mainMenuSize = GET_MENU_SIZE(mainMenu);
 
 float value = 0;
 
-// Example callback function
-void foo() {
-  Serial.print("Generic foo() function sees value is set to ");
+// Moves done by foo()
+enum Move { LEFT_EAR, RIGHT_EAR, BACK, CENTER, FRONT, TWITCH };
+const char * const moves[] = {
+  "left ear", "right ear", "back", "center", "front", "twitch"
+};
+
+// Example callback function, the context tells which entry was chosen
+void foo(int move) {
+  Serial.print("Generic foo() function moves ");
+  Serial.print(moves[move]);
+  Serial.print(" and sees value is set to ");
   Serial.println(value);
 }
 
@@ -68,25 +82,24 @@ const char subMenuStr9[] = "I - Input a value";
 
 // Define the sub-menu
 // The last two menu entries declare their string directly
-const SerialMenuEntry subMenu[] = {
-  {subMenuStr0, true, 'l', foo },
-  {subMenuStr1, true, 'r', foo},
+SERIALMENU_MENU(SubMenu) = {
+  {subMenuStr0, true, 'l', foo, LEFT_EAR},
+  {subMenuStr1, true, 'r', foo, RIGHT_EAR},
   {subMenuStr2, true, 'd', [](){ Serial.println(--value); }},
   {subMenuStr3, true, 'n', [](){ value = 0; Serial.println(value); }},
   {subMenuStr4, true, 'u', [](){ Serial.println(++value); }},
-  {subMenuStr5, true, 'b', foo},
-  {subMenuStr6, true, 'c', foo},
-  {subMenuStr7, true, 'f', foo},
-  {subMenuStr8, false,'t', foo},
+  {subMenuStr5, true, 'b', foo, BACK},
+  {subMenuStr6, true, 'c', foo, CENTER},
+  {subMenuStr7, true, 'f', foo, FRONT},
+  {subMenuStr8, false,'t', foo, TWITCH},
   {subMenuStr9, false,'I',
-    [](){ value = menu.getNumber<float>("Input floating point: "); }},
+    [](){ SERIALMENU_BEGIN_ASYNC();
+          SERIALMENU_AWAIT_NUMBER(float, value, "Input floating point: ");
+          SERIALMENU_END_ASYNC(); }},
   {"M - Menu",  false, 'm',
     [](){ menu.show(); } },
-  {"< - Main",  false, '<',
-    [](){ menu.load(mainMenu, mainMenuSize);
-          menu.show(); } }
+  {"< - Main",  false, '<', SerialMenu::open<MainMenu> }
 };
-constexpr uint8_t subMenuSize = GET_MENU_SIZE(subMenu);
 
 ///////////////////////////////////////////////////////////////////////////////
 // Main program
@@ -98,7 +111,7 @@ void setup() {
   Serial.println(DEMOCOPYRIGHT);
 
   // Set the main menu as the current active menu
-  menu.load(mainMenu, mainMenuSize);
+  menu.load<MainMenu>();
 
   // Display the current menu
   menu.show();
@@ -0,0 +1,129 @@
+///////////////////////////////////////////////////////////////////////////////
+// Serial port Menus Demo3
+//
+// Usage:
+// - Compile and load this sketch onto your Arduino board. It needs a board
+//   with an EEPROM, like the Uno or the Mega.
+// - Keep the USB cable connected while the board is running.
+// - In the Arduino programming IDE, go in the "Tools" menu and click on the
+//   "Serial Monitor" menu entry.
+// A window should appear, and in it a menu will be displayed. Try to type
+// the first character of one of the menu entries, followed by enter, in the
+// window's text input field.
+//
+// If there is no clearly legible text shown in the window, set the speed to
+// 9600 baud, and set the autoscroll checkbox. Reset the board or reload the
+// program.
+//
+// The goal of this example is to show you how settings set with the menu can
+// survive a reset, and how to watch a variable change.
+// The main loop() ramps a level up to a target, at a given step per second.
+// Try entering the keys 't' and 's' to change the target and the step, then
+// reset the board: they are saved in EEPROM a few seconds after they are
+// set, or at once with the key 'v', and are restored at reset.
+// The key 'w' starts and stops watching the level change every second.
+///////////////////////////////////////////////////////////////////////////////
+#define DEMOCOPYRIGHT "SerialMenu demo3 - Copyright (c) 2019 Dan Truong"
+
+#if defined(ARDUINO) && defined(__has_include)
+#if !__has_include(<EEPROM.h>)
+#error "This example needs a board with the EEPROM library"
+#endif
+#endif
+
+#define SERIALMENU_ENABLE_WATCHES true
+#define SERIALMENU_ENABLE_PERSISTENCE true
+#include <SerialMenu.hpp>
+const SerialMenu& menu = SerialMenu::get();
+
+// Declare the settings, and the level the main loop() changes
+uint16_t target = 100;
+float step = 1.5;
+float level = 0;
+
+// Declare the variables saved in EEPROM
+const SerialMenuValue values[] = { &target, &step };
+constexpr uint8_t valuesSize = sizeof(values) / sizeof(SerialMenuValue);
+
+// Declare the variables to watch
+const SerialMenuWatch watches[] = {
+  {"level = ", false, &level}
+};
+constexpr uint8_t watchesSize = sizeof(watches) / sizeof(SerialMenuWatch);
+bool watching = false;
+
+// Declare the menu and its callback functions
+const SerialMenuEntry mainMenu[] = {
+  {
+    "set [T]arget",
+    false,
+    't',
+    [](){ target = menu.getNumber<uint16_t>("Input target = ");
+          menu.changed(target); }
+  },
+  {
+    "set [S]tep per second",
+    false,
+    's',
+    [](){ step = menu.getNumber<float>("Input step = ");
+          menu.changed(step); }
+  },
+  {
+    "show [L]evel",
+    false,
+    'l',
+    [](){ Serial.print("level = "); Serial.println(level); }
+  },
+  {
+    "[W]atch the level",
+    false,
+    'w',
+    [](){ watching = !watching;
+          menu.watch(watching ? watches : nullptr, watchesSize, 1000); }
+  },
+  {
+    "sa[V]e the settings now",
+    false,
+    'v',
+    [](){ menu.save(); }
+  },
+  {
+    "show [M]enu",
+    false,
+    'm',
+    [](){ menu.show(); }
+  }
+};
+constexpr uint8_t mainMenuSize = GET_MENU_SIZE(mainMenu);
+
+// Main code
+void setup() {
+  Serial.begin(9600);
+  while (!Serial){};
+  Serial.println(DEMOCOPYRIGHT);
+
+  // Restore the settings saved before the reset, if any
+  menu.persist(values, valuesSize);
+
+  menu.load(mainMenu, mainMenuSize);
+  menu.show();
+}
+
+void loop() {
+  menu.run(100);
+  // Ramp the level a tenth of a step every 100ms
+  const float delta = target - level;
+  if (delta > step / 10)
+  {
+    level += step / 10;
+  }
+  else if (delta < -step / 10)
+  {
+    level -= step / 10;
+  }
+  else
+  {
+    level = target;
+  }
+  delay(100);
+}
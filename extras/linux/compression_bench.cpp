@@ -0,0 +1,145 @@
+///////////////////////////////////////////////////////////////////////////////
+// SerialMenu compressed strings benchmark
+//
+// Compresses the labels of a large service menu with a dictionary of the
+// fragments they repeat, like SERIALMENU_ENABLE_COMPRESSION menus do, and
+// reports the compression ratio and the cost of decoding while printing.
+// It also checks that every label decodes back to its original text.
+//
+// Build from the library directory:
+//   g++ -std=gnu++11 -O2 -fpermissive -Isrc -o compression_bench
+//       extras/linux/compression_bench.cpp src/SerialMenu.cpp
+//       src/SerialMenuTty.cpp
+// Usage:
+//   ./compression_bench
+///////////////////////////////////////////////////////////////////////////////
+#define SERIALMENU_MINIMAL_FOOTPRINT true
+#define SERIALMENU_ENABLE_COMPRESSION true
+#include <SerialMenu.hpp>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+// Dictionary of the fragments service menus repeat
+const char * const dictionary[] PROGMEM = {
+  " threshold", "Motor ", "Sensor ", "Set ", "Show ", " - ", "Reset ",
+  " limit", " speed", " current", "Channel ", "Calibrate ", " offset"
+};
+constexpr uint8_t dictionarySize = sizeof(dictionary) / sizeof(char *);
+
+// Replace the dictionary's words by tokens, longest match first. This is
+// what the token macros of a sketch do at compile time.
+static std::string encode(const std::string & text)
+{
+  std::string out;
+  for (size_t i = 0; i < text.size();)
+  {
+    int best = -1;
+    size_t bestLen = 0;
+    for (uint8_t w = 0; w < dictionarySize; ++w)
+    {
+      const size_t len = strlen(dictionary[w]);
+      if (len > bestLen && text.compare(i, len, dictionary[w]) == 0)
+      {
+        best = w;
+        bestLen = len;
+      }
+    }
+    if (best >= 0)
+    {
+      out += char(0x80 | best);
+      i += bestLen;
+    }
+    else
+    {
+      out += text[i++];
+    }
+  }
+  return out;
+}
+
+// Print all labels through show()'s decoder, returns ns per byte printed
+static double printNsPerByte(const std::vector<std::string> & labels,
+                             size_t & bytes)
+{
+  const int rounds = 200;
+  bytes = 0;
+  const unsigned long start = micros();
+  for (int r = 0; r < rounds; ++r)
+  {
+    for (size_t i = 0; i < labels.size(); ++i)
+    {
+      bytes += SerialMenu::print(labels[i].c_str(), true);
+      // Drop the output, only the decoding is measured
+      Serial.getChannel().txLen = 0;
+    }
+  }
+  return (micros() - start) * 1000.0 / bytes;
+}
+
+int main()
+{
+  // A 300 entry service menu
+  static const char * const parts[] = { "Motor ", "Sensor ", "Channel " };
+  static const char * const actions[] = {
+    "Set %s%d threshold", "Show %s%d current", "Set %s%d speed limit",
+    "Calibrate %s%d offset", "Reset %s%d"
+  };
+  std::vector<std::string> labels;
+  std::vector<std::string> encoded;
+  for (int n = 0; labels.size() < 300; ++n)
+  {
+    char text[64];
+    char key = 'A' + n % 26;
+    int len = snprintf(text, sizeof(text), "%c - ", key);
+    snprintf(text + len, sizeof(text) - len, actions[n % 5],
+             parts[n % 3], n % 20);
+    labels.push_back(text);
+    encoded.push_back(encode(text));
+  }
+
+  // Check the decoder gives the labels back
+  SerialMenu::get();
+  SerialMenu::setDictionary(dictionary, dictionarySize);
+  for (size_t i = 0; i < labels.size(); ++i)
+  {
+    SerialMenuChannel & channel = Serial.getChannel();
+    channel.txLen = 0;
+    SerialMenu::print(encoded[i].c_str(), true);
+    if (labels[i] != std::string(channel.tx, channel.txLen))
+    {
+      fprintf(stderr, "decode mismatch: %s\n", labels[i].c_str());
+      return 1;
+    }
+    channel.txLen = 0;
+  }
+
+  // Flash used by the strings, with the dictionary and its pointer table
+  size_t plainSize = 0;
+  size_t packedSize = sizeof(dictionary);
+  for (uint8_t w = 0; w < dictionarySize; ++w)
+  {
+    packedSize += strlen(dictionary[w]) + 1;
+  }
+  for (size_t i = 0; i < labels.size(); ++i)
+  {
+    plainSize += labels[i].size() + 1;
+    packedSize += encoded[i].size() + 1;
+  }
+
+  size_t plainBytes;
+  size_t packedBytes;
+  const double plainNs = printNsPerByte(labels, plainBytes);
+  const double packedNs = printNsPerByte(encoded, packedBytes);
+
+  printf("labels:                    %zu\n", labels.size());
+  printf("plain strings bytes:       %zu\n", plainSize);
+  printf("compressed bytes:          %zu (dictionary of %d words included)\n",
+         packedSize, dictionarySize);
+  printf("compression ratio:         %.2f\n", double(plainSize) / packedSize);
+  printf("plain decode ns/byte:      %.2f\n", plainNs);
+  printf("compressed decode ns/byte: %.2f\n", packedNs);
+  return 0;
+}
@@ -0,0 +1,130 @@
+#!/bin/sh
+###############################################################################
+# SerialMenu footprint benchmark
+# SerialMenu - Copyright (c) 2019 Dan Truong
+#
+# Builds a reference sketch for every combination of
+# SERIALMENU_DISABLE_PROGMEM_SUPPORT, SERIALMENU_DISABLE_HEARTBEAT_ON_IDLE and
+# SERIALMENU_MINIMAL_FOOTPRINT, with menus of 2, 20 and 200 entries, and
+# prints the Flash and SRAM each one uses as CSV:
+#   target,no_progmem,no_heartbeat,minimal,entries,flash,sram
+#
+# Targets:
+# * Each board of $BOARDS (default arduino:avr:uno), when arduino-cli is
+#   installed with the board's core. flash and sram are what arduino-cli
+#   reports for the whole sketch.
+# * host, always: the sketch compiled with g++ -Os into an object file, as a
+#   proxy of the library's own cost. flash is text + data, sram data + bss.
+#
+# Usage, from the library directory:
+#   extras/linux/footprint.sh > footprint.csv
+#   BOARDS="arduino:avr:uno arduino:avr:mega" extras/linux/footprint.sh
+###############################################################################
+set -e
+
+LIBDIR=$(cd "$(dirname "$0")/../.." && pwd)
+WORKDIR=$(mktemp -d)
+trap 'rm -rf "$WORKDIR"' EXIT
+BOARDS=${BOARDS:-arduino:avr:uno}
+CXX=${CXX:-g++}
+ENTRIES="2 20 200"
+
+# Write the reference sketch to $1/$(basename $1).ino
+# Usage: sketch dir no_progmem no_heartbeat minimal entries
+sketch()
+{
+  mkdir -p "$1"
+  {
+    [ "$2" = 1 ] && echo "#define SERIALMENU_DISABLE_PROGMEM_SUPPORT true"
+    [ "$3" = 1 ] && echo "#define SERIALMENU_DISABLE_HEARTBEAT_ON_IDLE true"
+    [ "$4" = 1 ] && echo "#define SERIALMENU_MINIMAL_FOOTPRINT true"
+    echo "#include <SerialMenu.hpp>"
+    echo
+    # Strings in Flash unless PROGMEM support is disabled
+    i=0
+    while [ $i -lt "$5" ]; do
+      if [ "$2" = 1 ]; then
+        echo "const char s$i[] = \"$i - entry $i\";"
+      else
+        echo "const char s$i[] PROGMEM = \"$i - entry $i\";"
+      fi
+      i=$((i + 1))
+    done
+    echo
+    echo "void action() { Serial.println(\"ok\"); }"
+    echo
+    echo "const SerialMenuEntry mainMenu[] = {"
+    i=0
+    while [ $i -lt "$5" ]; do
+      # Keys cycle over letters, the action is shared by all entries
+      key=$(printf "\\$(printf '%03o' $((97 + i % 26)))")
+      if [ "$2" = 1 ]; then
+        echo "  {s$i, false, '$key', action},"
+      else
+        echo "  {s$i, true, '$key', action},"
+      fi
+      i=$((i + 1))
+    done
+    echo "};"
+    echo
+    echo "const SerialMenu& menu = SerialMenu::get();"
+    echo
+    echo "void setup() {"
+    echo "  menu.load(mainMenu, GET_MENU_SIZE(mainMenu));"
+    echo "  menu.show();"
+    echo "}"
+    echo
+    echo "void loop() {"
+    echo "  menu.run(100);"
+    echo "  delay(100);"
+    echo "}"
+  } > "$1/$(basename "$1").ino"
+}
+
+# Print "flash,sram" of the sketch in $1 for a board, or nothing on failure
+board_size()
+{
+  out=$(arduino-cli compile --fqbn "$2" --library "$LIBDIR" "$1" 2>&1) || return 0
+  flash=$(echo "$out" | sed -n 's/^Sketch uses \([0-9]*\) bytes.*/\1/p')
+  sram=$(echo "$out" | sed -n 's/^Global variables use \([0-9]*\) bytes.*/\1/p')
+  [ -n "$flash" ] && echo "$flash,${sram:-0}"
+}
+
+# Print "flash,sram" of the sketch in $1 compiled for the host
+host_size()
+{
+  "$CXX" -std=gnu++11 -Os -fno-exceptions -fno-rtti -fno-threadsafe-statics \
+    -fpermissive -w -I"$LIBDIR/src" -x c++ -c "$1/$(basename "$1").ino" \
+    -o "$1/sketch.o"
+  size "$1/sketch.o" | awk 'NR == 2 { print $1 + $2 "," $2 + $3 }'
+}
+
+if command -v arduino-cli > /dev/null 2>&1; then
+  HAVE_ARDUINO=1
+else
+  HAVE_ARDUINO=0
+  echo "arduino-cli not found, host sizes only" >&2
+fi
+
+echo "target,no_progmem,no_heartbeat,minimal,entries,flash,sram"
+for p in 0 1; do
+  for h in 0 1; do
+    for m in 0 1; do
+      for n in $ENTRIES; do
+        dir="$WORKDIR/menu_${p}${h}${m}_$n"
+        sketch "$dir" $p $h $m $n
+        if [ $HAVE_ARDUINO = 1 ]; then
+          for board in $BOARDS; do
+            result=$(board_size "$dir" "$board")
+            if [ -n "$result" ]; then
+              echo "$board,$p,$h,$m,$n,$result"
+            else
+              echo "$board: build failed" >&2
+            fi
+          done
+        fi
+        echo "host,$p,$h,$m,$n,$(host_size "$dir")"
+      done
+    done
+  done
+done
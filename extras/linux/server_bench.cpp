@@ -0,0 +1,211 @@
+///////////////////////////////////////////////////////////////////////////////
+// SerialMenu server load generator
+//
+// Starts a SerialMenuServer on a Unix domain socket, connects many clients to
+// it, and has every client send one key at a time and wait for the answer.
+// Reports the number of sessions, the commands dispatched per second, and the
+// latency of a command, from the key sent to the answer received.
+// Everything runs locally, no network is used.
+//
+// Build from the library directory:
+//   g++ -std=gnu++11 -O2 -fpermissive -Isrc -o server_bench
+//       extras/linux/server_bench.cpp src/SerialMenu.cpp
+//       src/SerialMenuTty.cpp src/SerialMenuServer.cpp
+// Usage:
+//   ./server_bench [sessions=64] [seconds=2]
+///////////////////////////////////////////////////////////////////////////////
+#define SERIALMENU_MINIMAL_FOOTPRINT true
+#include <SerialMenu.hpp>
+#include <SerialMenuServer.hpp>
+
+#include <algorithm>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+SerialMenu & menu = SerialMenu::get();
+
+// Every callback answers with exactly one line
+extern const SerialMenuEntry subMenu[];
+extern const uint8_t subMenuSize;
+uint16_t value = 0;
+
+const SerialMenuEntry mainMenu[] = {
+  {"A - Answer",   false, 'a', [](){ Serial.println("a"); } },
+  {"S - Sub-menu", false, 's', [](){ menu.load(subMenu, subMenuSize);
+                                     Serial.println("sub"); } },
+  {"Z - Sync",     false, 'z', [](){ Serial.println("sync"); } }
+};
+constexpr uint8_t mainMenuSize = GET_MENU_SIZE(mainMenu);
+
+const SerialMenuEntry subMenu[] = {
+  {"V - Value",    false, 'v', [](){ Serial.println(++value); } },
+  {"B - Back",     false, 'b', [](){ menu.load(mainMenu, mainMenuSize);
+                                     Serial.println("main"); } }
+};
+constexpr uint8_t subMenuSize = GET_MENU_SIZE(subMenu);
+
+// Keys each client sends in a loop, and visits both menus
+static const char script[] = "asvvb";
+
+static const char socketPath[] = "/tmp/serialmenu_bench.sock";
+
+static void serve()
+{
+  SerialMenuServer server(1024);
+  if (!server.begin(socketPath, mainMenu, mainMenuSize))
+  {
+    perror("server");
+    exit(1);
+  }
+  while (server.run());
+}
+
+static int connectClient()
+{
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, socketPath);
+
+  // The server may still be starting
+  for (int retry = 0; retry < 100; ++retry)
+  {
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0)
+    {
+      return fd;
+    }
+    close(fd);
+    usleep(10000);
+  }
+  return -1;
+}
+
+// Read a client's answers, returns how many lines ended
+static int readLines(int fd, const char * until = nullptr)
+{
+  char buffer[4096];
+  int lines = 0;
+  const ssize_t n = read(fd, buffer, sizeof(buffer));
+  for (ssize_t i = 0; i < n; ++i)
+  {
+    lines += (buffer[i] == '\n');
+  }
+  if (until && n > 0 && !memmem(buffer, n, until, strlen(until)))
+  {
+    return readLines(fd, until);
+  }
+  return lines;
+}
+
+int main(int argc, char ** argv)
+{
+  const int sessions = (argc > 1) ? atoi(argv[1]) : 64;
+  const int seconds = (argc > 2) ? atoi(argv[2]) : 2;
+
+  const pid_t server = fork();
+  if (server == 0)
+  {
+    serve();
+    return 0;
+  }
+
+  // Connect the clients, and get them past the menu shown on connection
+  std::vector<int> fds(sessions);
+  std::vector<unsigned long> sent(sessions);
+  std::vector<uint8_t> step(sessions);
+  const int epollFd = epoll_create1(EPOLL_CLOEXEC);
+  for (int i = 0; i < sessions; ++i)
+  {
+    fds[i] = connectClient();
+    if (fds[i] < 0)
+    {
+      perror("connect");
+      kill(server, SIGTERM);
+      return 1;
+    }
+    if (write(fds[i], "z", 1) != 1)
+    {
+      return 1;
+    }
+    readLines(fds[i], "sync");
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u32 = i;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, fds[i], &ev);
+  }
+
+  // Every client sends a key, and the next one when the answer arrived
+  std::vector<unsigned long> latencies;
+  latencies.reserve(1 << 20);
+  const unsigned long start = micros();
+  const unsigned long stop = start + seconds * 1000000UL;
+  for (int i = 0; i < sessions; ++i)
+  {
+    sent[i] = micros();
+    if (write(fds[i], &script[step[i]], 1) != 1)
+    {
+      return 1;
+    }
+  }
+
+  int pending = sessions;
+  while (pending)
+  {
+    struct epoll_event events[64];
+    const int n = epoll_wait(epollFd, events, 64, 1000);
+    for (int e = 0; e < n; ++e)
+    {
+      const int i = events[e].data.u32;
+      if (readLines(fds[i]) == 0)
+      {
+        continue;
+      }
+      const unsigned long now = micros();
+      latencies.push_back(now - sent[i]);
+
+      if (now >= stop)
+      {
+        --pending;
+        continue;
+      }
+      step[i] = (step[i] + 1) % (sizeof(script) - 1);
+      sent[i] = now;
+      if (write(fds[i], &script[step[i]], 1) != 1)
+      {
+        return 1;
+      }
+    }
+    if (n <= 0)
+    {
+      break;
+    }
+  }
+  const double elapsed = (micros() - start) / 1e6;
+
+  kill(server, SIGTERM);
+  waitpid(server, nullptr, 0);
+  unlink(socketPath);
+
+  std::sort(latencies.begin(), latencies.end());
+  const size_t count = latencies.size();
+  if (!count)
+  {
+    return 1;
+  }
+  printf("sessions:        %d\n", sessions);
+  printf("commands:        %zu\n", count);
+  printf("commands/s:      %.0f\n", count / elapsed);
+  printf("latency p50 us:  %lu\n", latencies[count / 2]);
+  printf("latency p99 us:  %lu\n", latencies[count * 99 / 100]);
+  printf("latency max us:  %lu\n", latencies[count - 1]);
+  return 0;
+}
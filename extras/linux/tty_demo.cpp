@@ -0,0 +1,33 @@
+///////////////////////////////////////////////////////////////////////////////
+// Serial port Menus on a Linux host
+//
+// Runs the unmodified demo2 sketch menus in a Linux program, on the terminal
+// or on a serial device given on the command line.
+//
+// Build from the library directory (like the Arduino IDE, -fpermissive lets
+// the sketch call the menu through a const reference):
+//   g++ -std=gnu++11 -fpermissive -Isrc -o tty_demo
+//       extras/linux/tty_demo.cpp src/SerialMenu.cpp src/SerialMenuTty.cpp
+// Usage:
+//   ./tty_demo                 # menus on this terminal, Ctrl-C to quit
+//   ./tty_demo /dev/ttyUSB0    # menus on a serial line
+//   echo '>lu<1' | ./tty_demo  # scripted input, exits at end of input
+///////////////////////////////////////////////////////////////////////////////
+#include "../../examples/demo2/demo2.ino"
+
+int main(int argc, char ** argv)
+{
+  if (argc > 1 && !Serial.open(argv[1]))
+  {
+    return 1;
+  }
+
+  setup();
+
+  // Instead of loop(), which polls every 100ms, sleep until there is input
+  while (Serial)
+  {
+    menu.run();
+  }
+  return 0;
+}
@@ -1,3 +1,14 @@
+#ifndef SERIALMENU_HPP
+#define SERIALMENU_HPP true
+
+#if defined(ARDUINO)
+#include <avr/pgmspace.h>
+#include <HardwareSerial.h>
+#else
+// Host build: run the menus on a Linux tty, see SerialMenuTty.hpp
+#include "SerialMenuTty.hpp"
+#endif
+
 #if SERIALMENU_DISABLE_PROGMEM_SUPPORT != true
 constexpr PROGMEM char SERIAL_MENU_COPYRIGHT[] = 
 #else
@@ -58,7 +69,7 @@ constexpr char SERIAL_MENU_COPYRIGHT[] =
 // //// Definition of menu1: ///
 // //// Text is either embedded direct or a string name is referenced ////
 // //// Text in FLASH via PROGMEM is flagged as true ////
-// //// The menu entry's key tp press is specified (converts to lowercase) ////
+// //// The menu entry's key tp press is specified (letters in any case) ////
 // //// followed by the lambda functions ////
 // const SerialMenuEntry menu1[] = {
 //  {"X (Text in SRAM)", false, '1', [](){ Serial.println("choice X!"); } },
@@ -113,14 +124,18 @@ constexpr char SERIAL_MENU_COPYRIGHT[] =
 // tracks a pointer to the callback to run when the menu is selected, a pointer
 // to the string to display (the pointer can be a PROGMEM pointer), and a key
 // which is the keypress that will trigger the selection of this menu entry.
-// The keys are converted to lowercase by OR-ing 0x20. Since the bit 0x20 is
-// not used, it is used as a flag to tell if the string is stored in FLASH via
-// PROGMEM, or if it is stored in SRAM like regular data.
+// Keys are ASCII characters, letters converted to lowercase. Since the bit
+// 0x80 is not used, it is used as a flag to tell if the string is stored in
+// FLASH via PROGMEM, or if it is stored in SRAM like regular data. A key
+// beyond ASCII is stored as 0, which no input chooses, and a warning is
+// printed. Without PROGMEM support the key takes all 8 bits. Key sets take
+// any 8 bit key.
 //
 // The SerialMenu class is a singleton class. Only one instance can exist.
-// To do so we provide the get() method, which if needed allocates that one
-// singleton instance. To prevent other instances to exist, the constructor is
-// kept private. Furthermore I declared all the class variables static.
+// To do so we provide the get() method, which returns that one statically
+// allocated instance. To prevent other instances to exist, the constructor is
+// kept private. Furthermore I declared all the class variables static, and
+// they are defined in this header, so the library needs no heap at all.
 //
 // The usage pattern is to copy the pointer to the array. We must pass the size
 // too so a macro is provided for that. One those are in SerialMenu, the show()
@@ -141,11 +156,11 @@ constexpr char SERIAL_MENU_COPYRIGHT[] =
 // I don't foresee the need for much, except maybe support menus on other I/O
 // device with a print() or println() implementation. For example LCD screen
 // drivers. I would have to figure out how to do that (template?)
+//
+// The same menus can already run in a Linux program, on a terminal or a
+// serial device. See SerialMenuTty.hpp.
 ///////////////////////////////////////////////////////////////////////////////
 
-#include <avr/pgmspace.h>
-#include <HardwareSerial.h>
-
 ///////////////////////////////////////////////////////////////////////////////
 // If user doesn't specify disabling PROGMEM support, support is on by default.
 // To disable set SERIALMENU_DISABLE_PROGMEM_SUPPORT explicitly to true.
@@ -160,12 +175,299 @@ constexpr char SERIAL_MENU_COPYRIGHT[] =
 ///////////////////////////////////////////////////////////////////////////////
 //#define SERIALMENU_DISABLE_HEARTBEAT_ON_IDLE true
 
+///////////////////////////////////////////////////////////////////////////////
+// The heartbeat LED can be blinked by a hardware timer interrupt instead of
+// run(). run() then only starts the timer when there is no input and stops
+// it on input, and the blinking no longer depends on how often run() is
+// called. On AVR boards this takes Timer1, which libraries like Servo also
+// use, and PWM on the pins Timer1 drives, 9 and 10 on an Uno. On the host a
+// mock timer stands in, see Timer1 in SerialMenuTty.hpp.
+// To enable set SERIALMENU_ENABLE_TIMER_HEARTBEAT explicitly to true, and
+// write SERIALMENU_TIMER_HEARTBEAT_ISR() once in the sketch to define the
+// timer's interrupt handler.
+///////////////////////////////////////////////////////////////////////////////
+//#define SERIALMENU_ENABLE_TIMER_HEARTBEAT true
+
 ///////////////////////////////////////////////////////////////////////////////
 // The library prints some extra text like copyrights etc.
 // To disable set SERIALMENU_MINIMAL_FOOTPRINT explicitly to true.
 ///////////////////////////////////////////////////////////////////////////////
 //#define SERIALMENU_MINIMAL_FOOTPRINT true
 
+///////////////////////////////////////////////////////////////////////////////
+// Baud rate of the Serial console, 9600 by default. begin() starts Serial at
+// this rate unless given another. Watches and transmitUs() count with it.
+///////////////////////////////////////////////////////////////////////////////
+#ifndef SERIALMENU_BAUD_RATE
+#define SERIALMENU_BAUD_RATE 9600
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// Callbacks can wait for user input without blocking loop(), see
+// SERIALMENU_BEGIN_ASYNC() below. This costs a little code in run() and 4B of
+// SRAM, so it is off by default.
+// To enable set SERIALMENU_ENABLE_ASYNC_CALLBACKS explicitly to true.
+///////////////////////////////////////////////////////////////////////////////
+//#define SERIALMENU_ENABLE_ASYNC_CALLBACKS true
+
+///////////////////////////////////////////////////////////////////////////////
+// On an ANSI/VT100 terminal, show() can draw the menu at the top of the
+// screen and later only rewrite the lines that changed, and showValue() only
+// the values that changed. The callbacks' output scrolls below the menu.
+// This is a lot less bytes per refresh on slow links, but the Arduino IDE's
+// Serial Monitor does not support it. It costs 6B of SRAM per menu row.
+// To enable set SERIALMENU_ENABLE_ANSI_RENDERER explicitly to true.
+// SERIALMENU_ANSI_MAX_ROWS is the number of menu rows drawn (32 max): the
+// page's entries, then the page footer and the global entries if any,
+// SERIALMENU_ANSI_SCREEN_ROWS the terminal's height,
+// SERIALMENU_ANSI_VALUE_COLUMN where showValue() draws values, and
+// SERIALMENU_ANSI_VALUE_SIZE the size of the biggest value it takes.
+///////////////////////////////////////////////////////////////////////////////
+//#define SERIALMENU_ENABLE_ANSI_RENDERER true
+#ifndef SERIALMENU_ANSI_MAX_ROWS
+#define SERIALMENU_ANSI_MAX_ROWS 16
+#endif
+#ifndef SERIALMENU_ANSI_SCREEN_ROWS
+#define SERIALMENU_ANSI_SCREEN_ROWS 24
+#endif
+#ifndef SERIALMENU_ANSI_VALUE_COLUMN
+#define SERIALMENU_ANSI_VALUE_COLUMN 32
+#endif
+#ifndef SERIALMENU_ANSI_VALUE_SIZE
+#if defined(ARDUINO)
+#define SERIALMENU_ANSI_VALUE_SIZE 4
+#else
+#define SERIALMENU_ANSI_VALUE_SIZE 8
+#endif
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// run() can print watched variables periodically, see watch(). Watches never
+// use more than SERIALMENU_WATCH_BANDWIDTH_PERCENT of the link's capacity,
+// and wait while there is user input to process.
+// To enable set SERIALMENU_ENABLE_WATCHES explicitly to true.
+///////////////////////////////////////////////////////////////////////////////
+//#define SERIALMENU_ENABLE_WATCHES true
+#ifndef SERIALMENU_WATCH_BANDWIDTH_PERCENT
+#define SERIALMENU_WATCH_BANDWIDTH_PERCENT 25
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// Type of menu sizes and entry indexes. Menus have up to 255 entries with the
+// default uint8_t, set it to uint16_t for bigger menus.
+///////////////////////////////////////////////////////////////////////////////
+#ifndef SERIALMENU_SIZE_TYPE
+#define SERIALMENU_SIZE_TYPE uint8_t
+#endif
+typedef SERIALMENU_SIZE_TYPE SerialMenuSize;
+
+///////////////////////////////////////////////////////////////////////////////
+// show() can display big menus one page of entries at a time. The page keys
+// show the next and previous pages, and the other keys select an entry of
+// the page shown. Only the entries of the page are read. Paging is used for
+// menus with more than SERIALMENU_PAGE_SIZE entries, 0 disables it.
+///////////////////////////////////////////////////////////////////////////////
+#ifndef SERIALMENU_PAGE_SIZE
+#define SERIALMENU_PAGE_SIZE 0
+#endif
+#ifndef SERIALMENU_PAGE_NEXT_KEY
+#define SERIALMENU_PAGE_NEXT_KEY '+'
+#endif
+#ifndef SERIALMENU_PAGE_PREV_KEY
+#define SERIALMENU_PAGE_PREV_KEY '-'
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// The search key starts an incremental search over the current menu's
+// entries: each key typed narrows the entries shown to those containing the
+// text typed so far, ignoring case. Enter runs the first entry found, Escape
+// leaves the search. It costs about 1B of SRAM per 8 entries searched.
+// To enable set SERIALMENU_ENABLE_SEARCH explicitly to true.
+// The first SERIALMENU_SEARCH_MAX_ENTRIES entries of a menu are searched,
+// 64 by default: raise it for bigger menus, a search then says how many
+// entries it covers. The text is SERIALMENU_SEARCH_MAX_LENGTH characters at
+// most, and SERIALMENU_SEARCH_MAX_SHOWN entries at most are printed per key.
+///////////////////////////////////////////////////////////////////////////////
+//#define SERIALMENU_ENABLE_SEARCH true
+#ifndef SERIALMENU_SEARCH_KEY
+#define SERIALMENU_SEARCH_KEY '/'
+#endif
+#ifndef SERIALMENU_SEARCH_MAX_ENTRIES
+#define SERIALMENU_SEARCH_MAX_ENTRIES 64
+#endif
+#ifndef SERIALMENU_SEARCH_MAX_LENGTH
+#define SERIALMENU_SEARCH_MAX_LENGTH 16
+#endif
+#ifndef SERIALMENU_SEARCH_MAX_SHOWN
+#define SERIALMENU_SEARCH_MAX_SHOWN 5
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// PROGMEM strings can be compressed with a dictionary of fragments they
+// share, see setDictionary(). Bytes 0x80 to 0xFF in PROGMEM strings are then
+// dictionary tokens instead of characters.
+// To enable set SERIALMENU_ENABLE_COMPRESSION explicitly to true.
+///////////////////////////////////////////////////////////////////////////////
+//#define SERIALMENU_ENABLE_COMPRESSION true
+
+///////////////////////////////////////////////////////////////////////////////
+// A menu entry can be chosen with a set of keys instead of one key, like
+// "0-9" or "yYoO", and its callback gets the key typed. One entry then does
+// the job of several. It costs 2B of SRAM per entry on AVR boards.
+// To enable set SERIALMENU_ENABLE_KEY_SETS explicitly to true.
+///////////////////////////////////////////////////////////////////////////////
+//#define SERIALMENU_ENABLE_KEY_SETS true
+
+///////////////////////////////////////////////////////////////////////////////
+// A menu entry can carry a context value passed to its callback, so that one
+// function serves several entries which differ by a parameter. It costs
+// 3B of SRAM per entry on AVR boards.
+// To enable set SERIALMENU_ENABLE_CONTEXT_CALLBACKS explicitly to true.
+///////////////////////////////////////////////////////////////////////////////
+//#define SERIALMENU_ENABLE_CONTEXT_CALLBACKS true
+
+///////////////////////////////////////////////////////////////////////////////
+// A menu can be generated instead of stored in an array: a function tells how
+// many entries the menu has, and another builds entry i when show() or run()
+// needs it. Menus of things found at run time, like I2C devices or files,
+// then take no SRAM and are always up to date.
+// To enable set SERIALMENU_ENABLE_GENERATED_MENUS explicitly to true.
+///////////////////////////////////////////////////////////////////////////////
+//#define SERIALMENU_ENABLE_GENERATED_MENUS true
+
+///////////////////////////////////////////////////////////////////////////////
+// The export key prints the current menu and the variables watched as JSON,
+// one object per line, for tools to read what a board offers rather than
+// parse show()'s text. By default it is Ctrl-E (ENQ, "enquiry").
+// To enable set SERIALMENU_ENABLE_EXPORT explicitly to true.
+///////////////////////////////////////////////////////////////////////////////
+//#define SERIALMENU_ENABLE_EXPORT true
+#ifndef SERIALMENU_EXPORT_KEY
+#define SERIALMENU_EXPORT_KEY 0x05
+#endif
+
+// Entries whose callback gets an argument
+#if SERIALMENU_ENABLE_KEY_SETS == true || \
+    SERIALMENU_ENABLE_CONTEXT_CALLBACKS == true
+#define SERIALMENU_CALLBACK_ARGUMENTS true
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// Key sequences can be recorded as macros saved in EEPROM, and replayed at
+// once. The record key followed by a name key starts recording, the record
+// key again saves the keys typed in between. The play key followed by the
+// name replays them without showing the menus in between.
+// To enable set SERIALMENU_ENABLE_MACROS explicitly to true.
+// SERIALMENU_MACRO_SLOTS macros of up to SERIALMENU_MACRO_MAX_KEYS keys are
+// saved from EEPROM address SERIALMENU_MACRO_EEPROM_ADDRESS, each one using
+// SERIALMENU_MACRO_MAX_KEYS + 2 bytes. Recording uses as many bytes of SRAM.
+///////////////////////////////////////////////////////////////////////////////
+//#define SERIALMENU_ENABLE_MACROS true
+#ifndef SERIALMENU_MACRO_RECORD_KEY
+#define SERIALMENU_MACRO_RECORD_KEY '@'
+#endif
+#ifndef SERIALMENU_MACRO_PLAY_KEY
+#define SERIALMENU_MACRO_PLAY_KEY '!'
+#endif
+#ifndef SERIALMENU_MACRO_SLOTS
+#define SERIALMENU_MACRO_SLOTS 4
+#endif
+#ifndef SERIALMENU_MACRO_MAX_KEYS
+#define SERIALMENU_MACRO_MAX_KEYS 32
+#endif
+#ifndef SERIALMENU_MACRO_EEPROM_ADDRESS
+#define SERIALMENU_MACRO_EEPROM_ADDRESS 0
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// Variables set with the menus can be saved in EEPROM and restored at reset,
+// see persist(). A callback calls changed() after setting one, and run()
+// saves it once there was no other change for SERIALMENU_PERSIST_DELAY_MS,
+// or save() saves all the changes at once.
+// To enable set SERIALMENU_ENABLE_PERSISTENCE explicitly to true.
+// Up to SERIALMENU_PERSIST_MAX_VALUES variables of up to
+// SERIALMENU_PERSIST_MAX_SIZE bytes are saved in a log using the
+// SERIALMENU_PERSIST_EEPROM_SIZE bytes from SERIALMENU_PERSIST_EEPROM_ADDRESS.
+// The log is written round robin, so its bytes wear out evenly.
+///////////////////////////////////////////////////////////////////////////////
+//#define SERIALMENU_ENABLE_PERSISTENCE true
+#ifndef SERIALMENU_PERSIST_MAX_VALUES
+#define SERIALMENU_PERSIST_MAX_VALUES 16
+#endif
+#ifndef SERIALMENU_PERSIST_MAX_SIZE
+#define SERIALMENU_PERSIST_MAX_SIZE 4
+#endif
+#ifndef SERIALMENU_PERSIST_EEPROM_ADDRESS
+#define SERIALMENU_PERSIST_EEPROM_ADDRESS 256
+#endif
+#ifndef SERIALMENU_PERSIST_EEPROM_SIZE
+#define SERIALMENU_PERSIST_EEPROM_SIZE 256
+#endif
+#ifndef SERIALMENU_PERSIST_DELAY_MS
+#define SERIALMENU_PERSIST_DELAY_MS 2000
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// getArray() reads a list of numbers pasted at once into an array. It sends
+// XOFF to pause the sender when SERIALMENU_BULK_XOFF_LEVEL bytes wait in the
+// receive buffer, and XON to resume it when SERIALMENU_BULK_XON_LEVEL or less
+// are left. The defaults fit the 64 bytes buffer of AVR boards, leaving room
+// for the bytes the sender has already sent when it gets XOFF.
+///////////////////////////////////////////////////////////////////////////////
+#ifndef SERIALMENU_BULK_XOFF_LEVEL
+#define SERIALMENU_BULK_XOFF_LEVEL 48
+#endif
+#ifndef SERIALMENU_BULK_XON_LEVEL
+#define SERIALMENU_BULK_XON_LEVEL 16
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// run() can count the input bytes, and check the receive buffer each time it
+// is called: found full, bytes were likely lost while loop() was busy, an
+// overrun. When more than SERIALMENU_TYPEAHEAD_LIMIT keys came while a
+// callback ran, and are all that waits, they are dropped rather than run as
+// stale commands (0 keeps them all). Input sent before, like a pasted list
+// of commands, is kept. run() prints a warning line for both, unless
+// SERIALMENU_DISABLE_INPUT_WARNINGS is set to true. See getInputStats().
+// On the host no input is lost, so there are no overruns.
+// To enable set SERIALMENU_ENABLE_INPUT_STATS explicitly to true.
+///////////////////////////////////////////////////////////////////////////////
+//#define SERIALMENU_ENABLE_INPUT_STATS true
+#ifndef SERIALMENU_RX_BUFFER_SIZE
+#ifdef SERIAL_RX_BUFFER_SIZE
+#define SERIALMENU_RX_BUFFER_SIZE SERIAL_RX_BUFFER_SIZE
+#else
+#define SERIALMENU_RX_BUFFER_SIZE 64
+#endif
+#endif
+#ifndef SERIALMENU_TYPEAHEAD_LIMIT
+#define SERIALMENU_TYPEAHEAD_LIMIT 0
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// getChar(), getNumber() and getArray() block until the input is typed. An
+// idle hook set with setIdleHook() is called over and over meanwhile, so that
+// the sketch can keep servicing a watchdog or a control loop, and the longest
+// gap between two calls is measured, see getIdleMaxGapUs().
+// To enable set SERIALMENU_ENABLE_IDLE_HOOK explicitly to true.
+///////////////////////////////////////////////////////////////////////////////
+//#define SERIALMENU_ENABLE_IDLE_HOOK true
+
+///////////////////////////////////////////////////////////////////////////////
+// A global menu holds the entries chosen in every menu, like "M - Menu" or
+// "? - Help", instead of repeating them in each one, see loadGlobal(). The
+// keys it takes are kept in a 16 bytes bitmap, so run() finds in one lookup
+// whether a key is global. Global keys come first: the first show() or run()
+// of a menu prints a warning for the entries they shadow.
+// To enable set SERIALMENU_ENABLE_GLOBAL_MENU explicitly to true.
+///////////////////////////////////////////////////////////////////////////////
+//#define SERIALMENU_ENABLE_GLOBAL_MENU true
+
+#if (SERIALMENU_ENABLE_MACROS == true || \
+     SERIALMENU_ENABLE_PERSISTENCE == true) && defined(ARDUINO)
+#include <EEPROM.h>
+#endif
+
 
 ///////////////////////////////////////////////////////////////////////////////
 // Define a menu entry as:
@@ -173,264 +475,3082 @@ constexpr char SERIAL_MENU_COPYRIGHT[] =
 // - a boolean to specify if the message is in SRAM or PROGMEM Flash memory
 // - a menu key to select
 // - a callback function to perform the menu action
+// - optionally a context value to pass to the callback
 ///////////////////////////////////////////////////////////////////////////////
 class SerialMenuEntry {
   public:
+    #if SERIALMENU_CALLBACK_ARGUMENTS == true
+    // Callback function that performs this menu's action. Entries chosen
+    // with a key set get the key typed, entries with a context get it.
+    union
+    {
+      void (*actionCallback)();
+      #if SERIALMENU_ENABLE_KEY_SETS == true
+      void (*keyCallback)(char key);
+      #endif
+      #if SERIALMENU_ENABLE_CONTEXT_CALLBACKS == true
+      void (*contextCallback)(int context);
+      #endif
+    };
+    #else
     // Callback function that performs this menu's action
     void (*actionCallback)();
+    #endif
 
   private:
     // Message to display via getMenu()
     // The pointer can be in SRAM or in FLASH (requires PROGMEM to access)
     const char * message;
-    // Keyboard character entry to select this menu entry, overloaded:
-    // We set bit 0x20 to 0 for normal message, to 1 for a PROGMEM message
+    // Keyboard character entry to select this menu entry, letters in
+    // lowercase, overloaded: we set bit 0x80 to 0 for normal message, to 1
+    // for a PROGMEM message
     const char key;
+
+    #if SERIALMENU_DISABLE_PROGMEM_SUPPORT != true
+    static constexpr uint8_t PROGMEM_FLAG = 0x80;
+    #else
+    static constexpr uint8_t PROGMEM_FLAG = 0x00;
+    #endif
+
+    // Key stored for key k, with the PROGMEM flag. Keys beyond ASCII would
+    // lose their top bit to the flag: they are stored as 0, never chosen,
+    // and SerialMenu warns about them.
+    static constexpr char keyOf(char k, bool isprogMem)
+    {
+      return (isprogMem ? PROGMEM_FLAG : 0) |
+             ((uint8_t(k) & PROGMEM_FLAG) ? 0 : toLower(k));
+    }
     
   public:
     // Constructor used to init the array of menu entries
-    SerialMenuEntry(const char * m, bool isprogMem, char k, void (*c)()) :
+    constexpr SerialMenuEntry(const char * m, bool isprogMem, char k, void (*c)()) :
       message(m),
-      //#if SERIALMENU_DISABLE_PROGMEM_SUPPORT != true
-        key(((isprogMem) ? (k|0x20) : (k&(~0x20)))),
-      //#else
-      //  key(k),
-      //#endif
+      key(keyOf(k, isprogMem)),
       actionCallback(c)
+      #if SERIALMENU_ENABLE_KEY_SETS == true
+      , keys(nullptr)
+      #endif
+      #if SERIALMENU_ENABLE_CONTEXT_CALLBACKS == true
+      , context(0)
+      , hasContext(false)
+      #endif
     {}
-  
-    // Get the menu message to display
-    inline const char * getMenu() const
-    {
-      return message;
-    }
 
-    inline bool isProgMem() const
+    #if SERIALMENU_ENABLE_KEY_SETS == true
+  private:
+    // Keys choosing this entry, if it uses a key set: single keys, and ranges
+    // written first-last. A '-' first or last is the '-' key.
+    const char * keys;
+
+  public:
+    // Constructor of an entry chosen by any key of a key set, for example:
+    // {"0-9 - select channel", false, "0-9", [](char k){ channel = k - '0'; }}
+    // Unlike single keys, keys of a set are case sensitive.
+    constexpr SerialMenuEntry(const char * m, bool isprogMem, const char * k,
+                              void (*c)(char)) :
+      keyCallback(c),
+      message(m),
+      key(isprogMem ? PROGMEM_FLAG : 0),
+      keys(k)
+      #if SERIALMENU_ENABLE_CONTEXT_CALLBACKS == true
+      , context(0)
+      , hasContext(false)
+      #endif
+    {}
+
+    // Key set choosing this entry, or null if it is a single key
+    inline const char * getKeys() const
     {
-      return key & 0x20;
+      return keys;
     }
+    #endif
 
-    // Check if the user input k matches this menu entry
-    // Characters are converted to lowecase ASCII.
-    // @note this impacts also symbols, not numbers, so test before using those
-    inline bool isChosen(const char k) const
+    // First key choosing this entry, lowercase for a single key
+    inline char getKey() const
     {
-      return (k|0x20) == (key|0x20);
+      #if SERIALMENU_ENABLE_KEY_SETS == true
+      if (keys)
+      {
+        return keys[0];
+      }
+      #endif
+      return key & ~PROGMEM_FLAG;
     }
-};
-
-///////////////////////////////////////////////////////////////////////////////
-// Macro to get the number of menu entries in a menu array.
-///////////////////////////////////////////////////////////////////////////////
-#define GET_MENU_SIZE(menu) sizeof(menu)/sizeof(SerialMenuEntry)
-
 
-///////////////////////////////////////////////////////////////////////////////
-// The menu is a singleton class in which you load an array of menu entries.
-//
-// Singleton:
-// In other words, you do not instantiate the class. Instead you declare a
-// pointer to the class and ask the class to allocate an instance of itself
-// once, and return a pointer to the only static instance the program has.
-// A call to SerialMenu::get() will always return the same pointer to that
-// one single instance.
-//
-///////////
-// Example:
-///////////
-// loop()
-// {
-//    SerialMenu& menu = SerialMenu::get();
-// }
-// @todo Instead of a singleton we could avoid having any instance and
-// convert methods to static methods using static data. It saves a pointer...
-///////////////////////////////////////////////////////////////////////////////
-class SerialMenu
-{
+    #if SERIALMENU_ENABLE_CONTEXT_CALLBACKS == true
   private:
-    // Usually Arduino boards have a status LED on them. If not the code should
-    // optimize away the LED control code because LED_BUILTIN should not be
-    // defined. If it is defined and the code breaks because the LED is not
-    // on the board, try to comment the SHOW_HEARTBEAT_ON_IDLE define.
-    #ifdef  LED_BUILTIN
-    #if SERIALMENU_DISABLE_HEARTBEAT_ON_IDLE != true
-    #define SERIALMENU_SHOW_HEARTBEAT_ON_IDLE true
-    #endif
-    #endif
-
-    // If PROGMEM is used, copy using this SRAM buffer size.
-    static constexpr uint8_t PROGMEM_BUF_SIZE = 8;
+    // Value passed to the callback, if it takes one
+    int context;
+    bool hasContext;
 
-    // This class implements a singleton desgin pattern with one static instance
-    static SerialMenu * singleton;
-
-    // Points to the array of menu entries for the current menu
-    static const SerialMenuEntry * menu;
-    // Count how long we've been waiting for the user to input data
-    static uint16_t waiting;
-    // number of entries in the current menu
-    static uint8_t size;
+  public:
+    // Constructor of an entry whose callback gets a context value, for
+    // example entries running the same function on different channels:
+    // {"A - read channel A", false, 'a', readChannel, 0},
+    // {"B - read channel B", false, 'b', readChannel, 1},
+    constexpr SerialMenuEntry(const char * m, bool isprogMem, char k,
+                              void (*c)(int), int ctx) :
+      contextCallback(c),
+      message(m),
+      key(keyOf(k, isprogMem)),
+      #if SERIALMENU_ENABLE_KEY_SETS == true
+      keys(nullptr),
+      #endif
+      context(ctx),
+      hasContext(true)
+    {}
 
-    // Private constructor for singleton design.
-    // Initializes with an empty menu, prepares serial console and staus LED.
-    SerialMenu()
+    inline int getContext() const
     {
-      Serial.begin(9600);
-      while (!Serial){};
+      return context;
+    }
+    #endif
 
-      #if SERIALMENU_MINIMAL_FOOTPRINT != true
-        #if SERIALMENU_DISABLE_PROGMEM_SUPPORT != true
-          char buffer[sizeof(SERIAL_MENU_COPYRIGHT)];
-          strlcpy_P(buffer, SERIAL_MENU_COPYRIGHT, sizeof(SERIAL_MENU_COPYRIGHT));
-          Serial.println(buffer);
-        #else
-          Serial.println(SERIAL_MENU_COPYRIGHT);
-        #endif
+    #if SERIALMENU_CALLBACK_ARGUMENTS == true
+    // True if the callback gets the key or a context
+    inline bool hasArgument() const
+    {
+      #if SERIALMENU_ENABLE_KEY_SETS == true
+      if (keys)
+      {
+        return true;
+      }
       #endif
-
-      // Prepare to blink built-in LED.
-      #ifdef SERIALMENU_SHOW_HEARTBEAT_ON_IDLE
+      #if SERIALMENU_ENABLE_CONTEXT_CALLBACKS == true
+      if (hasContext)
       {
-        pinMode(LED_BUILTIN, OUTPUT);
+        return true;
       }
       #endif
+      return false;
     }
 
-  public:
-    // Get a pointer to the one singleton instance of this class
-    static SerialMenu & get()
+    // Run this entry's callback, chosen with key k
+    inline void select(const char k) const
     {
-      if (singleton == nullptr)
+      #if SERIALMENU_ENABLE_KEY_SETS == true
+      if (keys)
+      {
+        keyCallback(k);
+        return;
+      }
+      #endif
+      #if SERIALMENU_ENABLE_CONTEXT_CALLBACKS == true
+      if (hasContext)
       {
-        singleton = new SerialMenu;
+        contextCallback(context);
+        return;
       }
-      return *singleton;
+      #endif
+      (void) k;
+      actionCallback();
     }
-
-    // Get a pointer to the one singleton instance of this class and point it
-    // to the current menu
-    static const SerialMenu & get(const SerialMenuEntry* array, uint8_t arraySize)
+    #endif
+  
+    // Get the menu message to display
+    constexpr const char * getMenu() const
     {
-      (void) SerialMenu::get();
-      singleton->load(array, arraySize);
-      return *singleton;
+      return message;
     }
-    
-    // Install the current menu to display
-    inline void load(const SerialMenuEntry* array, uint8_t arraySize)
+
+    constexpr bool isProgMem() const
     {
-      menu = array;
-      size = arraySize;
+      return key & PROGMEM_FLAG;
     }
 
-    // Display the current menu on the Serial console
-    void show() const
+    // Lowercase of a letter, other characters are unchanged.
+    // One unsigned compare: characters below 'A' wrap over
+    static constexpr char toLower(const char c)
     {
-      #if SERIALMENU_MINIMAL_FOOTPRINT != true
-      Serial.println("\nMenu:");
-      #endif
+      return (uint8_t(c - 'A') < 26) ? (c | 0x20) : c;
+    }
 
-      for (uint8_t i = 0; i < size; ++i)
+    // Check if the user input k matches this menu entry
+    // Letters match in any case, other characters exactly.
+    inline bool isChosen(const char k) const
+    {
+      #if SERIALMENU_ENABLE_KEY_SETS == true
+      if (keys)
       {
-      #if SERIALMENU_DISABLE_PROGMEM_SUPPORT != true
-        if (menu[i].isProgMem())
-        {
-          // String in PROGMEM Flash, move it via a SRAM buffer to print it
-          char buffer[PROGMEM_BUF_SIZE];
-          const char * progMemPt = menu[i].getMenu();
-          uint8_t len = strlcpy_P(buffer, progMemPt, PROGMEM_BUF_SIZE);
-          Serial.print(buffer);
-          while (len >= PROGMEM_BUF_SIZE)
+        for (const char * p = keys; *p; ++p)
+        {
+          // A range: one compare, unsigned so keys below the first wrap over
+          if (p[1] == '-' && p[2])
           {
-            len -= PROGMEM_BUF_SIZE - 1;
-            progMemPt += PROGMEM_BUF_SIZE - 1;
-            // @todo replace strlcpy_P() and buffer with moving a uint32?
-            len = strlcpy_P(buffer, progMemPt, PROGMEM_BUF_SIZE);
-            Serial.print(buffer);
+            if (uint8_t(k - p[0]) <= uint8_t(p[2] - p[0]))
+            {
+              return true;
+            }
+            p += 2;
+          }
+          else if (k == *p)
+          {
+            return true;
           }
-          Serial.println("");
-        }
-        else
-      #endif
-        {
-          // String in data SRAM, print directly
-          Serial.println(menu[i].getMenu());
         }
+        return false;
       }
+      #endif
+      // No key is 0: that is how keys that can't be stored are kept
+      const char stored = key & ~PROGMEM_FLAG;
+      return stored && toLower(k) == stored;
     }
+};
 
-    // return a single ASCII character input read form the serial console.
-    // Note: this routine is blocking execution until a number is input
-    inline char getChar()
+///////////////////////////////////////////////////////////////////////////////
+// Define a watch, a variable printed periodically by run(), as:
+// - a label to print before the value
+// - a boolean to specify if the label is in SRAM or PROGMEM Flash memory
+// - a pointer to the variable
+// - optionally a function printing the variable, returning the bytes printed
+// Example:
+// const SerialMenuWatch watches[] = {
+//   {"y = ", false, &y},
+//   {"f = ", false, &f, [](const void * v) -> size_t {
+//     return Serial.print(*(const float *) v, 4); } }
+// };
+///////////////////////////////////////////////////////////////////////////////
+class SerialMenuWatch {
+  public:
+    const char * label;
+    const bool isProgMem;
+    const void * variable;
+    size_t (*format)(const void * variable);
+    #if SERIALMENU_ENABLE_EXPORT == true
+    // Type of the variable for the export: a kind, and the size in bytes
+    enum : uint8_t
     {
-      while (!Serial.available());
-      return Serial.read();
-    }
+      UNKNOWN = 0x00,
+      UNSIGNED = 0x10,
+      SIGNED = 0x20,
+      FLOAT = 0x30,
+      BOOL = 0x40,
+      TEXT = 0x50
+    };
+    const uint8_t type;
+    #endif
 
-    // return a number input read form the serial console.
-    // Note: this routine is blocking execution until a number is input
     template <class T>
-    inline T getNumber(const char * const message = nullptr)
+    constexpr SerialMenuWatch(const char * l, bool progMem, const T * v) :
+      label(l),
+      isProgMem(progMem),
+      variable(v),
+      format(&printValue<T>)
+      #if SERIALMENU_ENABLE_EXPORT == true
+      , type(typeOf(v))
+      #endif
+    {}
+
+    template <class T>
+    constexpr SerialMenuWatch(const char * l, bool progMem, const T * v,
+                              size_t (*f)(const void *)) :
+      label(l),
+      isProgMem(progMem),
+      variable(v),
+      format(f)
+      #if SERIALMENU_ENABLE_EXPORT == true
+      , type(typeOf(v))
+      #endif
+    {}
+
+    #if SERIALMENU_ENABLE_EXPORT == true
+    // Types the export can't describe, their value is exported as null
+    template <class T>
+    static constexpr uint8_t typeOf(const T *)
     {
-      T value = 0;
-      bool isNegative = false;
+      return UNKNOWN;
+    }
+    static constexpr uint8_t typeOf(const char *)
+    {
+      return (char(-1) < 0 ? SIGNED : UNSIGNED) | sizeof(char);
+    }
+    static constexpr uint8_t typeOf(const signed char *)
+    {
+      return SIGNED | sizeof(signed char);
+    }
+    static constexpr uint8_t typeOf(const unsigned char *)
+    {
+      return UNSIGNED | sizeof(unsigned char);
+    }
+    static constexpr uint8_t typeOf(const short *)
+    {
+      return SIGNED | sizeof(short);
+    }
+    static constexpr uint8_t typeOf(const unsigned short *)
+    {
+      return UNSIGNED | sizeof(unsigned short);
+    }
+    static constexpr uint8_t typeOf(const int *)
+    {
+      return SIGNED | sizeof(int);
+    }
+    static constexpr uint8_t typeOf(const unsigned int *)
+    {
+      return UNSIGNED | sizeof(unsigned int);
+    }
+    static constexpr uint8_t typeOf(const long *)
+    {
+      return SIGNED | sizeof(long);
+    }
+    static constexpr uint8_t typeOf(const unsigned long *)
+    {
+      return UNSIGNED | sizeof(unsigned long);
+    }
+    static constexpr uint8_t typeOf(const float *)
+    {
+      return FLOAT | sizeof(float);
+    }
+    static constexpr uint8_t typeOf(const double *)
+    {
+      return FLOAT | sizeof(double);
+    }
+    static constexpr uint8_t typeOf(const bool *)
+    {
+      return BOOL | sizeof(bool);
+    }
+    static constexpr uint8_t typeOf(const char * const *)
+    {
+      return TEXT;
+    }
+    static constexpr uint8_t typeOf(char * const *)
+    {
+      return TEXT;
+    }
+    #endif
+
+    // Default formatter for a variable of type T
+    template <class T>
+    static size_t printValue(const void * v)
+    {
+      return Serial.print(*(const T *) v);
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Define a variable saved in EEPROM, see SerialMenu::persist(), by its
+// address. Its size is deduced from its type.
+// Example:
+// const SerialMenuValue values[] = { &x, &f };
+///////////////////////////////////////////////////////////////////////////////
+class SerialMenuValue {
+  public:
+    void * const variable;
+    const uint8_t size;
+
+    template <class T>
+    constexpr SerialMenuValue(T * v) :
+      variable(v),
+      size(sizeof(T))
+    {
+      static_assert(sizeof(T) <= SERIALMENU_PERSIST_MAX_SIZE,
+                    "Variable bigger than SERIALMENU_PERSIST_MAX_SIZE");
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Input counters, see SerialMenu::getInputStats().
+///////////////////////////////////////////////////////////////////////////////
+struct SerialMenuInputStats {
+  // Bytes read from the Serial console
+  uint32_t bytes;
+  // Times run() found the receive buffer full
+  uint16_t overruns;
+  // Keys typed while a callback ran, beyond SERIALMENU_TYPEAHEAD_LIMIT,
+  // dropped by run()
+  uint16_t dropped;
+  // Most keys found waiting by run()
+  uint8_t maxTypeahead;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Macro to get the number of menu entries in a menu array.
+///////////////////////////////////////////////////////////////////////////////
+#define GET_MENU_SIZE(menu) sizeof(menu)/sizeof(SerialMenuEntry)
+
+///////////////////////////////////////////////////////////////////////////////
+// Macro to declare a menu as a type, with its entries, for
+// SerialMenu::load<name>() and SerialMenu::open<name>(). This only spares the
+// forward declarations and sizes: load<name>() stores the array and its size
+// like load(), and the links between menus are not checked.
+// Example:
+// SERIALMENU_MENU(MainMenu) = {
+//   {"1 - Print 1", false, '1', [](){ Serial.println("One"); }},
+// };
+///////////////////////////////////////////////////////////////////////////////
+#define SERIALMENU_MENU(name) \
+  struct name { static const SerialMenuEntry entries[]; }; \
+  const SerialMenuEntry name::entries[]
+
+
+///////////////////////////////////////////////////////////////////////////////
+// The static variables of SerialMenu.
+// Static members of a class template can be defined in a header without
+// being defined again in each file including it. So they are defined right
+// here, with the configuration the sketch chose, and each one is constant
+// initialized: no code runs to set them up at startup.
+///////////////////////////////////////////////////////////////////////////////
+template <class Unused = void>
+class SerialMenuState
+{
+  protected:
+    // Set once the LED was set up by begin() or start()
+    static bool started;
+    // Points to the array of menu entries for the current menu
+    static const SerialMenuEntry * menu;
+    // Count how long we've been waiting for the user to input data
+    static uint16_t waiting;
+    // number of entries in the current menu
+    static SerialMenuSize size;
+    // Page of the current menu shown when paging
+    static SerialMenuSize page;
+    // Async callback waiting for input, and the callback being run
+    static void (*resumeCallback)();
+    static void (*runningCallback)();
+    #if SERIALMENU_ENABLE_ASYNC_CALLBACKS == true
+    // Line of the SERIALMENU_AWAIT_*() the async callback waits at
+    static uint16_t resumeLine;
+    #endif
+
+    #if SERIALMENU_ENABLE_WATCHES == true
+    // Watched variables, and the refresh scheduler's state
+    struct WatchState
+    {
+      const SerialMenuWatch * list;
+      uint8_t count;
+      // Next watch to print, when, and how often one is printed
+      uint8_t next;
+      uint16_t dueMs;
+      uint16_t intervalMs;
+      // Byte budget in 1/1000th of bytes, may be negative after a print
+      int32_t budget;
+      uint16_t lastMs;
+    };
+    static WatchState watches;
+    #endif
+
+    // Dictionary of compressed PROGMEM strings
+    static const char * const * dictionary;
+    static uint8_t dictionarySize;
+
+    #if SERIALMENU_ENABLE_GENERATED_MENUS == true
+    // Functions generating the current menu, if it is generated
+    static SerialMenuEntry (*generator)(SerialMenuSize index);
+    static SerialMenuSize (*counter)();
+    #endif
+
+    #if SERIALMENU_ENABLE_GLOBAL_MENU == true
+    // Entries chosen in every menu, and the ASCII keys they take, one bit
+    // per key
+    static const SerialMenuEntry * globalMenu;
+    static SerialMenuSize globalSize;
+    static uint8_t globalKeys[16];
+    #endif
+};
+
+template <class U>
+bool SerialMenuState<U>::started = false;
+template <class U>
+const SerialMenuEntry * SerialMenuState<U>::menu = nullptr;
+template <class U>
+uint16_t SerialMenuState<U>::waiting = 0;
+template <class U>
+SerialMenuSize SerialMenuState<U>::size = 0;
+template <class U>
+SerialMenuSize SerialMenuState<U>::page = 0;
+template <class U>
+void (*SerialMenuState<U>::resumeCallback)() = nullptr;
+template <class U>
+void (*SerialMenuState<U>::runningCallback)() = nullptr;
+#if SERIALMENU_ENABLE_ASYNC_CALLBACKS == true
+template <class U>
+uint16_t SerialMenuState<U>::resumeLine = 0;
+#endif
+#if SERIALMENU_ENABLE_WATCHES == true
+template <class U>
+typename SerialMenuState<U>::WatchState SerialMenuState<U>::watches =
+  {nullptr, 0, 0, 0, 0, 0, 0};
+#endif
+template <class U>
+const char * const * SerialMenuState<U>::dictionary = nullptr;
+template <class U>
+uint8_t SerialMenuState<U>::dictionarySize = 0;
+#if SERIALMENU_ENABLE_GENERATED_MENUS == true
+template <class U>
+SerialMenuEntry (*SerialMenuState<U>::generator)(SerialMenuSize) = nullptr;
+template <class U>
+SerialMenuSize (*SerialMenuState<U>::counter)() = nullptr;
+#endif
+#if SERIALMENU_ENABLE_GLOBAL_MENU == true
+template <class U>
+const SerialMenuEntry * SerialMenuState<U>::globalMenu = nullptr;
+template <class U>
+SerialMenuSize SerialMenuState<U>::globalSize = 0;
+template <class U>
+uint8_t SerialMenuState<U>::globalKeys[16] = {};
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// The menu is a singleton class in which you load an array of menu entries.
+//
+// Singleton:
+// In other words, you do not instantiate the class. Instead you ask the class
+// for a reference to the only static instance the program has. A call to
+// SerialMenu::get() will always return the same reference to that one single
+// instance. The instance holds no data and is built at compile time, so it
+// can be declared at global scope before setup() runs. The serial console is
+// started by begin() or by the sketch, from setup().
+//
+///////////
+// Example:
+///////////
+// loop()
+// {
+//    SerialMenu& menu = SerialMenu::get();
+// }
+///////////////////////////////////////////////////////////////////////////////
+class SerialMenu : private SerialMenuState<>
+{
+  private:
+    // Usually Arduino boards have a status LED on them. If not the code should
+    // optimize away the LED control code because LED_BUILTIN should not be
+    // defined. If it is defined and the code breaks because the LED is not
+    // on the board, try to comment the SHOW_HEARTBEAT_ON_IDLE define.
+    #ifdef  LED_BUILTIN
+    #if SERIALMENU_DISABLE_HEARTBEAT_ON_IDLE != true
+    #define SERIALMENU_SHOW_HEARTBEAT_ON_IDLE true
+    #endif
+    #endif
+
+    // Blink it with a timer if asked and the board has Timer1, or the mock
+    #if SERIALMENU_ENABLE_TIMER_HEARTBEAT == true && \
+        SERIALMENU_DISABLE_HEARTBEAT_ON_IDLE != true && \
+        ((defined(LED_BUILTIN) && defined(TIMSK1)) || defined(SERIALMENU_TTY))
+    #define SERIALMENU_TIMER_HEARTBEAT true
+    #endif
+
+    // If PROGMEM is used, copy using this SRAM buffer size.
+    static constexpr uint8_t PROGMEM_BUF_SIZE = 8;
+
+    // Private constructor for singleton design. It does nothing so that the
+    // instance is built at compile time, begin() sets up the hardware.
+    constexpr SerialMenu()
+    {}
+
+  public:
+    // Starts the serial console at baudRate, and prepares the status LED.
+    // Call it from setup(), or start Serial from setup() instead: the first
+    // show(), run() or input read then prepares the LED, but leaves Serial
+    // as the sketch set it up. The hardware can't be set up before the
+    // core's init(), which runs after global constructors.
+    static void begin(const unsigned long baudRate = SERIALMENU_BAUD_RATE)
+    {
+      Serial.begin(baudRate);
+      while (!Serial){};
+      start();
+    }
+
+  private:
+    // Prints the copyright and prepares the status LED, once
+    static void start()
+    {
+      if (started)
+      {
+        return;
+      }
+      started = true;
+
+      #if SERIALMENU_MINIMAL_FOOTPRINT != true
+        #if SERIALMENU_DISABLE_PROGMEM_SUPPORT != true
+          char buffer[sizeof(SERIAL_MENU_COPYRIGHT)];
+          strlcpy_P(buffer, SERIAL_MENU_COPYRIGHT, sizeof(SERIAL_MENU_COPYRIGHT));
+          Serial.println(buffer);
+        #else
+          Serial.println(SERIAL_MENU_COPYRIGHT);
+        #endif
+      #endif
+
+      // Prepare to blink built-in LED.
+      #ifdef SERIALMENU_SHOW_HEARTBEAT_ON_IDLE
+      {
+        pinMode(LED_BUILTIN, OUTPUT);
+      }
+      #endif
+    }
+
+    #if SERIALMENU_TIMER_HEARTBEAT == true
+    // Timer heartbeat state
+    struct Heartbeat
+    {
+      bool armed;
+      // Interrupts since the timer started
+      volatile uint8_t ticks;
+      #ifndef SERIALMENU_TTY
+      // Writing the LED's bit to its PIN register toggles it atomically
+      volatile uint8_t * pin;
+      volatile uint8_t * port;
+      uint8_t mask;
+      #endif
+    };
+
+    static inline Heartbeat & heartbeat()
+    {
+      static Heartbeat state;
+      return state;
+    }
+
+    // Start blinking after 10s, a second at a time. Called from run(), so
+    // Timer1 is set up after the core's init(), which sets it up for PWM.
+    static void heartbeatArm()
+    {
+      Heartbeat & h = heartbeat();
+      h.ticks = 0;
+      h.armed = true;
+      #ifdef SERIALMENU_TTY
+      Timer1.start(1000, heartbeatTick);
+      #else
+      // Look up the LED's port so that the interrupt doesn't have to
+      h.pin = portInputRegister(digitalPinToPort(LED_BUILTIN));
+      h.port = portOutputRegister(digitalPinToPort(LED_BUILTIN));
+      h.mask = digitalPinToBitMask(LED_BUILTIN);
+
+      // CTC mode, clock / 1024, so F_CPU / 1024 counts per second
+      TCCR1A = 0;
+      TCCR1B = _BV(WGM12) | _BV(CS12) | _BV(CS10);
+      OCR1A = F_CPU / 1024 - 1;
+      TCNT1 = 0;
+      TIFR1 = _BV(OCF1A);
+      // Defined with the interrupt handler by SERIALMENU_TIMER_HEARTBEAT_ISR(),
+      // so that the build fails if the sketch doesn't define it
+      extern const uint8_t serialMenuTimerInterrupt;
+      TIMSK1 |= serialMenuTimerInterrupt;
+      #endif
+    }
+
+    // Stop blinking, with the LED off
+    static inline void heartbeatDisarm()
+    {
+      Heartbeat & h = heartbeat();
+      h.armed = false;
+      #ifdef SERIALMENU_TTY
+      Timer1.stop();
+      Timer1.setLed(false);
+      #else
+      TIMSK1 &= ~_BV(OCIE1A);
+      *h.port &= ~h.mask;
+      #endif
+    }
+
+  public:
+    // Timer interrupt handler: toggle the LED every second after 10s
+    static inline void heartbeatTick()
+    {
+      Heartbeat & h = heartbeat();
+      if (h.ticks < 10)
+      {
+        ++h.ticks;
+        return;
+      }
+      #ifdef SERIALMENU_TTY
+      Timer1.setLed(!Timer1.isLedOn());
+      #else
+      *h.pin = h.mask;
+      #endif
+    }
+    #endif
+
+  public:
+    // Get a reference to the one singleton instance of this class. It is
+    // constant initialized: no heap, no constructor run at startup. The
+    // hardware is set up later, see begin().
+    static SerialMenu & get()
+    {
+      static SerialMenu singleton;
+      return singleton;
+    }
+
+    // Get a reference to the one singleton instance of this class and point
+    // it to the current menu
+    static const SerialMenu & get(const SerialMenuEntry* array,
+                                  SerialMenuSize arraySize)
+    {
+      SerialMenu & singleton = SerialMenu::get();
+      singleton.load(array, arraySize);
+      return singleton;
+    }
+    
+    // Install the current menu to display
+    static inline void load(const SerialMenuEntry* array,
+                            SerialMenuSize arraySize)
+    {
+      menu = array;
+      size = arraySize;
+      page = 0;
+      #if SERIALMENU_ENABLE_GENERATED_MENUS == true
+      generator = nullptr;
+      counter = nullptr;
+      #endif
+    }
+
+    #if SERIALMENU_ENABLE_GENERATED_MENUS == true
+    // Install a generated menu to display. count() returns the number of
+    // entries, and generate(i) builds entry i each time it is shown or
+    // checked against a key, so it should be quick. The entry's message must
+    // stay valid until generate() is called again, e.g. a PROGMEM string or
+    // a static buffer. With the ANSI renderer, give each entry its own
+    // message pointer, as rows are redrawn when their pointer changes.
+    static inline void load(SerialMenuEntry (*generate)(SerialMenuSize index),
+                            SerialMenuSize (*count)())
+    {
+      menu = nullptr;
+      generator = generate;
+      counter = count;
+      size = count();
+      page = 0;
+    }
+    #endif
+
+    // Install a menu declared as a type, see SERIALMENU_MENU(). Its size is
+    // known at compile time, so there is no size to declare nor to keep.
+    template <class Menu>
+    static inline void load()
+    {
+      static_assert(GET_MENU_SIZE(Menu::entries) <= SerialMenuSize(~0),
+                    "Menu bigger than SERIALMENU_SIZE_TYPE can count");
+      load(Menu::entries, GET_MENU_SIZE(Menu::entries));
+    }
+
+    // Callback of an entry leading to a menu declared as a type: loads and
+    // shows it. The menu only needs to be declared, not defined, to be
+    // linked to, so menus linking to each other need no forward declaration
+    // of their entries and size:
+    // struct SubMenu;
+    // SERIALMENU_MENU(MainMenu) = {
+    //   {"> - Sub-menu", false, '>', SerialMenu::open<SubMenu>},
+    // };
+    template <class Menu>
+    static void open()
+    {
+      load<Menu>();
+      get().show();
+    }
+
+    #if SERIALMENU_ENABLE_GLOBAL_MENU == true
+    // Install the entries chosen in every menu, or nullptr for none. Their
+    // keys are chosen before the current menu's.
+    static void loadGlobal(const SerialMenuEntry * array,
+                           SerialMenuSize arraySize)
+    {
+      globalMenu = array;
+      globalSize = arraySize;
+      #if SERIALMENU_MINIMAL_FOOTPRINT != true
+      memset(checkedMenus(), 0, sizeof(CheckedMenus));
+      #endif
+      for (uint8_t k = 0; k < 0x80; ++k)
+      {
+        bool isGlobal = false;
+        for (SerialMenuSize i = 0; i < arraySize && !isGlobal; ++i)
+        {
+          isGlobal = array[i].isChosen(k);
+        }
+        if (isGlobal)
+        {
+          globalKeys[k >> 3] |= 1 << (k & 7);
+        }
+        else
+        {
+          globalKeys[k >> 3] &= ~(1 << (k & 7));
+        }
+      }
+    }
+
+    template <class Menu>
+    static inline void loadGlobal()
+    {
+      loadGlobal(Menu::entries, GET_MENU_SIZE(Menu::entries));
+    }
+
+  private:
+    // True if a global entry takes key k. Keys beyond ASCII are not in the
+    // bitmap, the global menu is searched for them.
+    static inline bool isGlobal(const char k)
+    {
+      return (uint8_t(k) < 0x80)
+             ? globalKeys[uint8_t(k) >> 3] & (1 << (k & 7))
+             : globalSize != 0;
+    }
+
+    #if SERIALMENU_MINIMAL_FOOTPRINT != true
+    // True if a global entry takes a key choosing entry e, set in k
+    static bool isShadowed(const SerialMenuEntry & e, char & k)
+    {
+      #if SERIALMENU_ENABLE_KEY_SETS == true
+      if (e.getKeys())
+      {
+        for (k = 0; uint8_t(k) < 0x80; ++k)
+        {
+          if (e.isChosen(k) && isGlobal(k))
+          {
+            return true;
+          }
+        }
+        return false;
+      }
+      #endif
+      k = e.getKey();
+      if (uint8_t(k) < 0x80)
+      {
+        return isGlobal(k);
+      }
+      for (SerialMenuSize i = 0; i < globalSize; ++i)
+      {
+        if (globalMenu[i].isChosen(k))
+        {
+          return true;
+        }
+      }
+      return false;
+    }
+    #endif
+
+  public:
+    #endif
+
+  private:
+    #if SERIALMENU_MINIMAL_FOOTPRINT != true
+    // Menu tables last checked by checkMenu(), the oldest replaced first, so
+    // that going back and forth between menus warns once
+    typedef const SerialMenuEntry * CheckedMenus[4];
+    static inline CheckedMenus & checkedMenus()
+    {
+      static CheckedMenus tables;
+      return tables;
+    }
+    #endif
+
+    // Warn about the entries of the current menu that can't be chosen, once
+    // per menu table: keys beyond ASCII, which the PROGMEM flag takes, and
+    // keys a global entry takes. Called by show() and run() rather than
+    // load(), which setup() may call before Serial is started.
+    static void checkMenu()
+    {
+      #if SERIALMENU_MINIMAL_FOOTPRINT != true
+      if (!menu)
+      {
+        return;
+      }
+      CheckedMenus & checked = checkedMenus();
+      const uint8_t count = sizeof(CheckedMenus) / sizeof(checked[0]);
+      for (uint8_t i = 0; i < count; ++i)
+      {
+        if (checked[i] == menu)
+        {
+          return;
+        }
+      }
+      memmove(&checked[1], &checked[0], sizeof(checked[0]) * (count - 1));
+      checked[0] = menu;
+      for (SerialMenuSize i = 0; i < size; ++i)
+      {
+        #if SERIALMENU_DISABLE_PROGMEM_SUPPORT != true
+        if (!menu[i].getKey())
+        {
+          Serial.print("Key beyond ASCII, can't be chosen: ");
+          print(menu[i]);
+          Serial.println("");
+          continue;
+        }
+        #endif
+        #if SERIALMENU_ENABLE_GLOBAL_MENU == true
+        char k;
+        if (globalSize && isShadowed(menu[i], k))
+        {
+          Serial.print("Global key ");
+          Serial.print(k);
+          Serial.print(" shadows: ");
+          print(menu[i]);
+          Serial.println("");
+        }
+        #endif
+      }
+      #endif
+    }
+
+  public:
+    // Get the current menu, for example to save it and load() it back later
+    inline const SerialMenuEntry * getCurrentMenu() const
+    {
+      return menu;
+    }
+    inline SerialMenuSize getCurrentMenuSize() const
+    {
+      return size;
+    }
+
+    // Get or set the page of the current menu to show
+    inline SerialMenuSize getPage() const
+    {
+      return page;
+    }
+    inline void setPage(SerialMenuSize p)
+    {
+      page = p;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Compressed PROGMEM strings
+    // Fragments repeated in many menu strings are stored once in a PROGMEM
+    // dictionary, and the strings use one byte tokens in their place: token
+    // "\x80" is the first word, "\x81" the second, up to 128 words. The
+    // compiler builds the compressed strings by concatenating literals.
+    // Close the literal after a token, as in "\x81" "abc", or the hex escape
+    // would swallow the hex digits which follow.
+    // show() decodes while printing, with no SRAM buffer.
+    // Example:
+    //   const char wordSet[] PROGMEM = "Set ";
+    //   const char wordMotor[] PROGMEM = "Motor ";
+    //   const char * const dict[] PROGMEM = { wordSet, wordMotor };
+    //   #define SET "\x80"
+    //   #define MOTOR "\x81"
+    //   const char str0[] PROGMEM = "S - " SET MOTOR "speed";
+    //   menu.setDictionary(dict, 2);
+    // Requires SERIALMENU_ENABLE_COMPRESSION set to true.
+    ///////////////////////////////////////////////////////////////////////////
+    static inline void setDictionary(const char * const * words, uint8_t count)
+    {
+      dictionary = words;
+      dictionarySize = count;
+    }
+
+    // Print a message stored in SRAM or in PROGMEM, without ending the line.
+    // Returns the number of bytes printed.
+    static size_t print(const char * message, bool isProgMem)
+    {
+      #if SERIALMENU_DISABLE_PROGMEM_SUPPORT != true
+      #if SERIALMENU_ENABLE_COMPRESSION == true
+      if (isProgMem)
+      {
+        // String in PROGMEM Flash, stream it byte by byte expanding tokens
+        size_t printed = 0;
+        for (uint8_t c; (c = pgm_read_byte(message)); ++message)
+        {
+          const uint8_t token = c & 0x7F;
+          if ((c & 0x80) && token < dictionarySize)
+          {
+            const char * word =
+              (const char *) pgm_read_ptr(&dictionary[token]);
+            for (uint8_t w; (w = pgm_read_byte(word)); ++word)
+            {
+              printed += Serial.write(w);
+            }
+          }
+          else
+          {
+            printed += Serial.write(c);
+          }
+        }
+        return printed;
+      }
+      else
+      #endif
+      if (isProgMem)
+      {
+        // String in PROGMEM Flash, move it via a SRAM buffer to print it
+        char buffer[PROGMEM_BUF_SIZE];
+        const char * progMemPt = message;
+        uint8_t len = strlcpy_P(buffer, progMemPt, PROGMEM_BUF_SIZE);
+        size_t printed = Serial.print(buffer);
+        while (len >= PROGMEM_BUF_SIZE)
+        {
+          len -= PROGMEM_BUF_SIZE - 1;
+          progMemPt += PROGMEM_BUF_SIZE - 1;
+          // @todo replace strlcpy_P() and buffer with moving a uint32?
+          len = strlcpy_P(buffer, progMemPt, PROGMEM_BUF_SIZE);
+          printed += Serial.print(buffer);
+        }
+        return printed;
+      }
+      else
+      #else
+      (void) isProgMem;
+      #endif
+      {
+        // String in data SRAM, print directly
+        return Serial.print(message);
+      }
+    }
+
+    // Print a menu entry's message, without ending the line
+    static inline size_t print(const SerialMenuEntry & entry)
+    {
+      return print(entry.getMenu(), entry.isProgMem());
+    }
+
+  private:
+    // Read a message stored in SRAM or in PROGMEM one character at a time,
+    // expanding the dictionary tokens of compressed strings, without buffer
+    class MessageReader
+    {
+      private:
+        const char * message;
+        const bool isProgMem;
+        #if SERIALMENU_ENABLE_COMPRESSION == true
+        // Position in a dictionary word being expanded, if any
+        const char * word;
+        #endif
+
+      public:
+        MessageReader(const char * m, bool progMem) :
+          message(m),
+          isProgMem(progMem)
+          #if SERIALMENU_ENABLE_COMPRESSION == true
+          , word(nullptr)
+          #endif
+        {}
+
+        // Next character, or 0 at the end of the message
+        char next()
+        {
+          for (;;)
+          {
+            char c;
+            #if SERIALMENU_ENABLE_COMPRESSION == true
+            if (word)
+            {
+              c = pgm_read_byte(word++);
+              if (c)
+              {
+                return c;
+              }
+              word = nullptr;
+            }
+            #endif
+            #if SERIALMENU_DISABLE_PROGMEM_SUPPORT != true
+            c = isProgMem ? pgm_read_byte(message) : *message;
+            #else
+            c = *message;
+            #endif
+            if (!c)
+            {
+              return 0;
+            }
+            ++message;
+            #if SERIALMENU_ENABLE_COMPRESSION == true
+            const uint8_t token = c & 0x7F;
+            if (isProgMem && (c & 0x80) && token < dictionarySize)
+            {
+              word = (const char *) pgm_read_ptr(&dictionary[token]);
+              continue;
+            }
+            #endif
+            return c;
+          }
+        }
+    };
+
+  public:
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Compile time output size of show(), and the time to transmit it.
+    // A menu table declared constexpr (C++17 for lambdas) can be measured:
+    //   constexpr SerialMenuEntry mainMenu[] = {...};
+    //   SERIALMENU_ASSERT_SHOW_BUDGET(SerialMenu::showBytes(mainMenu), 50000);
+    // With paging this is the biggest page and its footer. Pass the global
+    // menu's table too, if any, to count its entries shown after the menu's:
+    //   SerialMenu::showBytes(mainMenu, globalMenu)
+    // Otherwise, or for PROGMEM strings, list the messages, or the arrays
+    // they are declared in, as the page shown uses them, global entries
+    // included, and add showFooterBytes() for the menu's size with paging:
+    //   SERIALMENU_ASSERT_SHOW_BUDGET(
+    //     SerialMenu::showBytes(subMenuStr0, subMenuStr1, "M - Menu"), 50000);
+    // This is for the line by line renderer, the ANSI renderer sends less.
+    // Compressed strings are measured with the words their tokens stand for
+    // when the dictionary is passed first. It and its words must then be
+    // constexpr, PROGMEM or not:
+    //   constexpr char wordSet[] PROGMEM = "Set ";
+    //   constexpr const char * dict[] PROGMEM = { wordSet };
+    //   SerialMenu::showBytes(dict, mainMenu)
+    //   SerialMenu::showBytes(dict, str0, str1, "M - Menu")
+    // Without it, each token counts for one byte.
+    ///////////////////////////////////////////////////////////////////////////
+    // Bytes show() prints before the entries, and after each one
+    #if SERIALMENU_MINIMAL_FOOTPRINT != true
+    static constexpr uint32_t SHOW_TITLE_BYTES = sizeof("\nMenu:\r\n") - 1;
+    #else
+    static constexpr uint32_t SHOW_TITLE_BYTES = 0;
+    #endif
+    static constexpr uint32_t SHOW_EOL_BYTES = sizeof("\r\n") - 1;
+
+    // Length of a string, ::strlen() is not constexpr
+    static constexpr uint32_t constStrlen(const char * s)
+    {
+      return *s ? 1 + constStrlen(s + 1) : 0;
+    }
+
+    // Length of a string printed with the words of a dictionary of size
+    // words in place of its tokens
+    static constexpr uint32_t constStrlen(const char * s,
+                                          const char * const * words,
+                                          uint8_t size)
+    {
+      return !*s ? 0
+        : ((uint8_t(*s) & 0x80) && (uint8_t(*s) & 0x7F) < size)
+          ? constStrlen(words[uint8_t(*s) & 0x7F]) +
+            constStrlen(s + 1, words, size)
+          : 1 + constStrlen(s + 1, words, size);
+    }
+
+    // Bytes of the page footer show() prints for a menu of size entries,
+    // "Page 1/2 (- +)", the widest page number being the last
+    #if SERIALMENU_PAGE_SIZE > 0
+    static constexpr uint32_t showFooterBytes(uint32_t size)
+    {
+      return (size > SERIALMENU_PAGE_SIZE)
+        ? sizeof("Page / (- +)") - 1 +
+          2 * digits((size + SERIALMENU_PAGE_SIZE - 1) / SERIALMENU_PAGE_SIZE) +
+          SHOW_EOL_BYTES
+        : 0;
+    }
+    #else
+    static constexpr uint32_t showFooterBytes(uint32_t)
+    {
+      return 0;
+    }
+    #endif
+
+    // Bytes printed by show() for a constexpr menu table
+    template <size_t N>
+    static constexpr uint32_t showBytes(const SerialMenuEntry (&table)[N])
+    {
+      return SHOW_TITLE_BYTES + pageBytes(table, 0) + showFooterBytes(N);
+    }
+    // And the global menu's table
+    template <size_t N, size_t G>
+    static constexpr uint32_t showBytes(const SerialMenuEntry (&table)[N],
+                                        const SerialMenuEntry (&global)[G])
+    {
+      return showBytes(table) + entriesBytes(global, 0, G);
+    }
+
+    // Bytes printed by show() for a menu with these messages
+    static constexpr uint32_t showBytes()
+    {
+      return SHOW_TITLE_BYTES;
+    }
+    template <size_t N, class... Messages>
+    static constexpr uint32_t showBytes(const char (&message)[N],
+                                        const Messages & ... messages)
+    {
+      return N - 1 + SHOW_EOL_BYTES + showBytes(messages...);
+    }
+
+    #if SERIALMENU_ENABLE_COMPRESSION == true
+    // The same, for menus with strings compressed with a dictionary
+    template <size_t D, size_t N>
+    static constexpr uint32_t showBytes(const char * const (&dict)[D],
+                                        const SerialMenuEntry (&table)[N])
+    {
+      return SHOW_TITLE_BYTES + pageBytes(table, 0, dict, D) +
+             showFooterBytes(N);
+    }
+    template <size_t D, size_t N, size_t G>
+    static constexpr uint32_t showBytes(const char * const (&dict)[D],
+                                        const SerialMenuEntry (&table)[N],
+                                        const SerialMenuEntry (&global)[G])
+    {
+      return showBytes(dict, table) + entriesBytes(global, 0, G, dict, D);
+    }
+    // The messages listed are all compressed, PROGMEM strings
+    template <size_t D>
+    static constexpr uint32_t showBytes(const char * const (&)[D])
+    {
+      return SHOW_TITLE_BYTES;
+    }
+    template <size_t D, size_t N, class... Messages>
+    static constexpr uint32_t showBytes(const char * const (&dict)[D],
+                                        const char (&message)[N],
+                                        const Messages & ... messages)
+    {
+      return constStrlen(message, dict, D) + SHOW_EOL_BYTES +
+             showBytes(dict, messages...);
+    }
+    #endif
+
+  private:
+    static constexpr uint32_t digits(uint32_t n)
+    {
+      return n < 10 ? 1 : 1 + digits(n / 10);
+    }
+
+    // Bytes of the entries [begin, end[ of a table, one per line. PROGMEM
+    // messages are expanded with the dictionary of size words, if any.
+    template <size_t N>
+    static constexpr uint32_t entriesBytes(const SerialMenuEntry (&table)[N],
+                                           size_t begin, size_t end,
+                                           const char * const * words = nullptr,
+                                           uint8_t size = 0)
+    {
+      return (begin < end)
+        ? ((words && table[begin].isProgMem())
+            ? constStrlen(table[begin].getMenu(), words, size)
+            : constStrlen(table[begin].getMenu())) + SHOW_EOL_BYTES +
+          entriesBytes(table, begin + 1, end, words, size)
+        : 0;
+    }
+
+    // Bytes of the biggest page of a table from entry begin on
+    template <size_t N>
+    static constexpr uint32_t pageBytes(const SerialMenuEntry (&table)[N],
+                                        size_t begin,
+                                        const char * const * words = nullptr,
+                                        uint8_t size = 0)
+    {
+      #if SERIALMENU_PAGE_SIZE > 0
+      return (N > SERIALMENU_PAGE_SIZE && begin < N)
+        ? maxBytes(entriesBytes(table, begin,
+                     (begin + SERIALMENU_PAGE_SIZE < N) ?
+                       begin + SERIALMENU_PAGE_SIZE : N, words, size),
+                   pageBytes(table, begin + SERIALMENU_PAGE_SIZE, words, size))
+        : (begin ? 0 : entriesBytes(table, 0, N, words, size));
+      #else
+      return begin ? 0 : entriesBytes(table, 0, N, words, size);
+      #endif
+    }
+    static constexpr uint32_t maxBytes(uint32_t a, uint32_t b)
+    {
+      return a > b ? a : b;
+    }
+
+  public:
+    // Microseconds to send bytes at a baud rate, 10 bits per byte on the line
+    static constexpr uint32_t transmitUs(uint32_t bytes,
+                                         uint32_t baud = SERIALMENU_BAUD_RATE)
+    {
+      return uint32_t(uint64_t(bytes) * 10 * 1000000 / baud);
+    }
+
+    // Display the current menu on the Serial console
+    void show() const
+    {
+      start();
+      checkMenu();
+      #if SERIALMENU_ENABLE_MACROS == true
+      // Only the menu reached at the end of a macro is shown
+      if (macro().playing)
+      {
+        return;
+      }
+      #endif
+
+      updateSize();
+      #if SERIALMENU_ENABLE_ANSI_RENDERER == true
+      showAnsi();
+      #else
+      #if SERIALMENU_MINIMAL_FOOTPRINT != true
+      Serial.println("\nMenu:");
+      #endif
+
+      const SerialMenuSize end = pageEnd();
+      for (SerialMenuSize i = pageBegin(); i < end; ++i)
+      {
+        print(entry(i));
+        Serial.println("");
+      }
+
+      #if SERIALMENU_PAGE_SIZE > 0
+      if (size > SERIALMENU_PAGE_SIZE)
+      {
+        printFooter();
+        Serial.println("");
+      }
+      #endif
+
+      #if SERIALMENU_ENABLE_GLOBAL_MENU == true
+      for (SerialMenuSize i = 0; i < globalSize; ++i)
+      {
+        print(globalMenu[i]);
+        Serial.println("");
+      }
+      #endif
+      #endif
+    }
+
+  private:
+    // Entry i of the current menu
+    #if SERIALMENU_ENABLE_GENERATED_MENUS == true
+    static inline SerialMenuEntry entry(SerialMenuSize i)
+    {
+      return generator ? generator(i) : menu[i];
+    }
+    #else
+    static inline const SerialMenuEntry & entry(SerialMenuSize i)
+    {
+      return menu[i];
+    }
+    #endif
+
+    // A generated menu's size may change between two uses
+    static inline void updateSize()
+    {
+      #if SERIALMENU_ENABLE_GENERATED_MENUS == true
+      if (counter)
+      {
+        size = counter();
+        #if SERIALMENU_PAGE_SIZE > 0
+        const SerialMenuSize pages = pageCount();
+        page = (page < pages) ? page : 0;
+        #endif
+      }
+      #endif
+    }
+
+    // Range of entries of the page shown: all of them unless paging
+    static inline SerialMenuSize pageBegin()
+    {
+      #if SERIALMENU_PAGE_SIZE > 0
+      return (size > SERIALMENU_PAGE_SIZE) ? page * SERIALMENU_PAGE_SIZE : 0;
+      #else
+      return 0;
+      #endif
+    }
+    static inline SerialMenuSize pageEnd()
+    {
+      #if SERIALMENU_PAGE_SIZE > 0
+      const uint32_t end = uint32_t(pageBegin()) + SERIALMENU_PAGE_SIZE;
+      return (end < size) ? end : size;
+      #else
+      return size;
+      #endif
+    }
+    #if SERIALMENU_PAGE_SIZE > 0
+    static inline SerialMenuSize pageCount()
+    {
+      return (size + SERIALMENU_PAGE_SIZE - 1) / SERIALMENU_PAGE_SIZE;
+    }
+
+    // Print the page shown and the keys changing pages: "Page 1/2 (- +)"
+    static void printFooter()
+    {
+      Serial.print("Page ");
+      Serial.print(page + 1);
+      Serial.print('/');
+      Serial.print(pageCount());
+      Serial.print(" (");
+      Serial.print(SERIALMENU_PAGE_PREV_KEY);
+      Serial.print(' ');
+      Serial.print(SERIALMENU_PAGE_NEXT_KEY);
+      Serial.print(")");
+    }
+    #endif
+
+  public:
+
+    // Display a value next to a menu entry, for example the variable the
+    // entry sets. With the ANSI renderer the value is drawn on the entry's
+    // line, and only if it changed since it was last drawn. Otherwise the
+    // entry and the value are printed on a new line.
+    template <class T>
+    static void showValue(SerialMenuSize index, const T value)
+    {
+      start();
+      if (index < pageBegin() || index >= pageEnd())
+      {
+        return;
+      }
+      #if SERIALMENU_ENABLE_ANSI_RENDERER == true
+      // Index of the row on screen
+      index -= pageBegin();
+      if (index >= SERIALMENU_ANSI_MAX_ROWS)
+      {
+        return;
+      }
+      // Compare the value's bytes with what is on screen
+      static_assert(sizeof(T) <= SERIALMENU_ANSI_VALUE_SIZE,
+                    "Value bigger than SERIALMENU_ANSI_VALUE_SIZE");
+      AnsiScreen & screen = ansiScreen();
+      uint8_t bytes[SERIALMENU_ANSI_VALUE_SIZE] = {};
+      memcpy(bytes, &value, sizeof(T));
+      const uint32_t bit = uint32_t(1) << index;
+      if ((screen.valueShown & bit) &&
+          !memcmp(screen.values[index], bytes, sizeof(bytes)))
+      {
+        return;
+      }
+      memcpy(screen.values[index], bytes, sizeof(bytes));
+      screen.valueShown |= bit;
+
+      Serial.print("\x1b" "7");
+      ansiMoveTo(ANSI_FIRST_ROW + index, SERIALMENU_ANSI_VALUE_COLUMN);
+      Serial.print(value);
+      Serial.print("\x1b[K" "\x1b" "8");
+      #else
+      print(entry(index));
+      Serial.print(' ');
+      Serial.println(value);
+      #endif
+    }
+
+    #if SERIALMENU_ENABLE_ANSI_RENDERER == true
+    // Forget what is on screen, so the next show() draws everything again.
+    // Call it if the terminal was cleared or reconnected.
+    static inline void redraw()
+    {
+      ansiScreen().drawn = false;
+    }
+    #endif
+
+  private:
+    #if SERIALMENU_ENABLE_ANSI_RENDERER == true
+    // Screen row of the first menu entry, below the title
+    #if SERIALMENU_MINIMAL_FOOTPRINT != true
+    static constexpr uint8_t ANSI_FIRST_ROW = 2;
+    #else
+    static constexpr uint8_t ANSI_FIRST_ROW = 1;
+    #endif
+    static_assert(SERIALMENU_ANSI_MAX_ROWS <= 32, "At most 32 ANSI menu rows");
+
+    // What was last drawn on the screen: the message of each menu row, and
+    // the value shown next to it if its bit is set in valueShown. The page
+    // footer's row has the address of footer as message, and footer holds
+    // the page and the page count it shows. hidden is the number of rows
+    // past SERIALMENU_ANSI_MAX_ROWS last warned about.
+    struct AnsiScreen
+    {
+      bool drawn;
+      uint32_t valueShown;
+      const char * messages[SERIALMENU_ANSI_MAX_ROWS];
+      uint8_t values[SERIALMENU_ANSI_MAX_ROWS][SERIALMENU_ANSI_VALUE_SIZE];
+      uint32_t footer;
+      SerialMenuSize hidden;
+    };
+
+    static inline AnsiScreen & ansiScreen()
+    {
+      static AnsiScreen screen;
+      return screen;
+    }
+
+    static void ansiMoveTo(uint8_t row, uint8_t column)
+    {
+      Serial.print("\x1b[");
+      Serial.print(row);
+      Serial.print(';');
+      Serial.print(column);
+      Serial.print('H');
+    }
+
+    // Draw the menu at the top of the screen, rewriting only the rows whose
+    // entry changed. The rows below scroll the callbacks' output.
+    static void showAnsi()
+    {
+      AnsiScreen & screen = ansiScreen();
+      constexpr uint8_t outputRow = ANSI_FIRST_ROW + SERIALMENU_ANSI_MAX_ROWS;
+
+      if (!screen.drawn)
+      {
+        // Clear the screen and confine scrolling below the menu
+        Serial.print("\x1b[2J\x1b[");
+        Serial.print(outputRow);
+        Serial.print(';');
+        Serial.print(SERIALMENU_ANSI_SCREEN_ROWS);
+        Serial.print('r');
+        #if SERIALMENU_MINIMAL_FOOTPRINT != true
+        Serial.print("\x1b[1;1HMenu:");
+        #endif
+        for (uint8_t i = 0; i < SERIALMENU_ANSI_MAX_ROWS; ++i)
+        {
+          screen.messages[i] = nullptr;
+        }
+        screen.valueShown = 0;
+        screen.hidden = 0;
+      }
+      bool moved = false;
+
+      // Rows: the page's entries, the page footer, then the global entries
+      const SerialMenuSize first = pageBegin();
+      const SerialMenuSize rows = pageEnd() - first;
+      #if SERIALMENU_PAGE_SIZE > 0
+      const uint8_t footerRows = (size > SERIALMENU_PAGE_SIZE) ? 1 : 0;
+      const uint32_t footer = (uint32_t(page) << 16) | pageCount();
+      #else
+      const uint8_t footerRows = 0;
+      #endif
+      const char * const footerRow = (const char *) &screen.footer;
+      for (uint8_t i = 0; i < SERIALMENU_ANSI_MAX_ROWS; ++i)
+      {
+        // Menu messages are constant, comparing the pointer is enough
+        const SerialMenuEntry * global = nullptr;
+        const char * message = nullptr;
+        if (i < rows)
+        {
+          message = entry(first + i).getMenu();
+        }
+        else if (i < rows + footerRows)
+        {
+          message = footerRow;
+        }
+        #if SERIALMENU_ENABLE_GLOBAL_MENU == true
+        else if (i - rows - footerRows < globalSize)
+        {
+          global = &globalMenu[i - rows - footerRows];
+          message = global->getMenu();
+        }
+        #endif
+        #if SERIALMENU_PAGE_SIZE > 0
+        if (message == footerRow && screen.footer != footer)
+        {
+          screen.messages[i] = nullptr;
+          screen.footer = footer;
+        }
+        #endif
+        if (message == screen.messages[i])
+        {
+          continue;
+        }
+        if (screen.drawn && !moved)
+        {
+          // Come back where the output was when done
+          Serial.print("\x1b" "7");
+          moved = true;
+        }
+        ansiMoveTo(ANSI_FIRST_ROW + i, 1);
+        if (global)
+        {
+          print(*global);
+        }
+        #if SERIALMENU_PAGE_SIZE > 0
+        else if (message == footerRow)
+        {
+          printFooter();
+        }
+        #endif
+        else if (message)
+        {
+          print(entry(first + i));
+        }
+        Serial.print("\x1b[K");
+        screen.messages[i] = message;
+        screen.valueShown &= ~(uint32_t(1) << i);
+      }
+
+      if (!screen.drawn)
+      {
+        ansiMoveTo(outputRow, 1);
+        screen.drawn = true;
+      }
+      else if (moved)
+      {
+        Serial.print("\x1b" "8");
+      }
+
+      // Rows past the limit are not drawn: say so in the output, once
+      SerialMenuSize total = rows + footerRows;
+      #if SERIALMENU_ENABLE_GLOBAL_MENU == true
+      total += globalSize;
+      #endif
+      const SerialMenuSize hidden = (total > SERIALMENU_ANSI_MAX_ROWS)
+                                  ? total - SERIALMENU_ANSI_MAX_ROWS : 0;
+      if (hidden != screen.hidden)
+      {
+        screen.hidden = hidden;
+        if (hidden)
+        {
+          Serial.print(hidden);
+          Serial.println(" menu rows not drawn, see SERIALMENU_ANSI_MAX_ROWS");
+        }
+      }
+    }
+    #endif
+
+    #if SERIALMENU_ENABLE_IDLE_HOOK == true
+    // Hook called while waiting for input, and the gaps between calls
+    struct Idle
+    {
+      void (*hook)();
+      // Time of the last call, and the longest gap measured
+      unsigned long lastUs;
+      unsigned long maxGapUs;
+    };
+
+    static inline Idle & idle()
+    {
+      static Idle state;
+      return state;
+    }
+
+    // Call the idle hook, measuring the time since the wait started or the
+    // previous call
+    static inline void idleCall()
+    {
+      Idle & i = idle();
+      i.hook();
+      const unsigned long now = micros();
+      if (now - i.lastUs > i.maxGapUs)
+      {
+        i.maxGapUs = now - i.lastUs;
+      }
+      i.lastUs = now;
+    }
+    #endif
+
+    // No timeout
+    static constexpr unsigned long FOREVER = ~0UL;
+
+    // Wait for the user to type something, for timeoutMs at most since
+    // startMs unless it is FOREVER. Returns false on timeout.
+    // On the host the process sleeps until there is input, the input is
+    // closed or the timeout, instead of spinning.
+    static bool waitInput(const unsigned long timeoutMs = FOREVER,
+                          const unsigned long startMs = 0)
+    {
+      start();
+      #if SERIALMENU_ENABLE_IDLE_HOOK == true
+      if (idle().hook)
+      {
+        idle().lastUs = micros();
+      }
+      #endif
+      while (!inputAvailable())
+      {
+        #if SERIALMENU_ENABLE_IDLE_HOOK == true
+        if (idle().hook)
+        {
+          idleCall();
+        }
+        #endif
+
+        int sleepMs = -1;
+        if (timeoutMs != FOREVER)
+        {
+          const unsigned long elapsed = millis() - startMs;
+          if (elapsed >= timeoutMs)
+          {
+            return false;
+          }
+          sleepMs = timeoutMs - elapsed;
+        }
+
+        #ifdef SERIALMENU_TTY
+        #if SERIALMENU_ENABLE_IDLE_HOOK == true
+        // Sleep a little between idle calls
+        if (idle().hook)
+        {
+          sleepMs = 1;
+        }
+        #endif
+        if (!Serial.wait(sleepMs) && !Serial)
+        {
+          return false;
+        }
+        #else
+        (void) sleepMs;
+        #endif
+      }
+      return true;
+    }
+
+    #if SERIALMENU_ENABLE_MACROS == true
+    // Macro being recorded or replayed
+    struct Macro
+    {
+      // Macro key waiting for the name of a macro, or 0
+      char command;
+      // Name of the macro recorded, or 0, and the keys recorded so far
+      char recording;
+      bool overflow;
+      uint8_t length;
+      char keys[SERIALMENU_MACRO_MAX_KEYS];
+      // Set while replaying, with the EEPROM address of the next key and the
+      // number of keys left
+      bool playing;
+      uint16_t playAddress;
+      uint8_t playLeft;
+    };
+
+    static inline Macro & macro()
+    {
+      static Macro state;
+      return state;
+    }
+    #endif
+
+    #if SERIALMENU_ENABLE_INPUT_STATS == true
+    static inline SerialMenuInputStats & inputStats()
+    {
+      static SerialMenuInputStats stats;
+      return stats;
+    }
+
+    // Check the receive buffer for lost bytes
+    static void inputCheck()
+    {
+      SerialMenuInputStats & stats = inputStats();
+      const int pending = Serial.available();
+      if (pending > stats.maxTypeahead)
+      {
+        stats.maxTypeahead = pending < 255 ? pending : 255;
+      }
+
+      // The ring buffer holds one byte less than its size. On the host
+      // the kernel buffers the input and reads are up to the buffer's size,
+      // so a full buffer is normal and nothing is lost.
+      #ifndef SERIALMENU_TTY
+      if (pending >= SERIALMENU_RX_BUFFER_SIZE - 1)
+      {
+        ++stats.overruns;
+        #if SERIALMENU_DISABLE_INPUT_WARNINGS != true
+        Serial.println("Input overrun: keys may be lost");
+        #endif
+      }
+      #endif
+    }
+
+    #if SERIALMENU_TYPEAHEAD_LIMIT > 0
+    // Drop the keys typed while a callback ran, if there are more than the
+    // limit and no input from before the callback still waits. older is
+    // the number of bytes that waited before the callback and it didn't read.
+    static void dropTypeahead(int older)
+    {
+      #if SERIALMENU_ENABLE_ASYNC_CALLBACKS == true
+      // Keys typed for a callback awaiting input are not stale
+      if (resumeCallback)
+      {
+        return;
+      }
+      #endif
+      const int pending = Serial.available();
+      if (older > 0 || pending <= SERIALMENU_TYPEAHEAD_LIMIT)
+      {
+        return;
+      }
+      // Not read by readInput(): these are not recorded in a macro either
+      for (int i = 0; i < pending; ++i)
+      {
+        Serial.read();
+      }
+      SerialMenuInputStats & stats = inputStats();
+      stats.bytes += pending;
+      stats.dropped += pending;
+      #if SERIALMENU_DISABLE_INPUT_WARNINGS != true
+      Serial.print("Input dropped: ");
+      Serial.print(pending);
+      Serial.println(" keys typed ahead");
+      #endif
+    }
+    #endif
+    #endif
+
+    // Number of input bytes available, from the macro replayed if any
+    static inline int inputAvailable()
+    {
+      #if SERIALMENU_ENABLE_MACROS == true
+      if (macro().playLeft)
+      {
+        return macro().playLeft;
+      }
+      #endif
+      return Serial.available();
+    }
+
+    // Read one input byte, from the macro replayed if any. Recording keeps
+    // the bytes read, whatever reads them: a menu choice or a getNumber().
+    static inline char readInput()
+    {
+      #if SERIALMENU_ENABLE_MACROS == true
+      Macro & m = macro();
+      char c;
+      if (m.playLeft)
+      {
+        --m.playLeft;
+        c = EEPROM.read(m.playAddress++);
+      }
+      else
+      {
+        c = Serial.read();
+        #if SERIALMENU_ENABLE_INPUT_STATS == true
+        ++inputStats().bytes;
+        #endif
+      }
+      if (m.recording)
+      {
+        if (m.length < SERIALMENU_MACRO_MAX_KEYS)
+        {
+          m.keys[m.length++] = c;
+        }
+        else
+        {
+          m.overflow = true;
+        }
+      }
+      return c;
+      #else
+      #if SERIALMENU_ENABLE_INPUT_STATS == true
+      ++inputStats().bytes;
+      #endif
+      return Serial.read();
+      #endif
+    }
+
+    // Number being typed for pollNumber(). Its value and decimals are the
+    // bytes of the caller's type, so that the state doesn't depend on it.
+    struct PollNumber
+    {
+      uint8_t state;
+      bool isNegative;
+      uint8_t value[8];
+      uint8_t decimals[8];
+    };
+
+    static inline PollNumber & pollState()
+    {
+      static PollNumber state;
+      return state;
+    }
+
+  public:
+    // return a single ASCII character input read form the serial console.
+    // Note: this routine is blocking execution until a number is input
+    static inline char getChar()
+    {
+      waitInput();
+      return readInput();
+    }
+
+    // return a number input read form the serial console.
+    // Note: this routine is blocking execution until a number is input
+    template <class T>
+    static inline T getNumber(const char * const message = nullptr)
+    {
+      T value;
+      getNumber(value, 0, FOREVER, message);
+      return value;
+    }
+
+    // Wait timeoutMs at most for a character. Returns false and sets c to
+    // defaultValue if none was typed in time.
+    static bool getChar(char & c, const char defaultValue,
+                        const unsigned long timeoutMs)
+    {
+      if (!waitInput(timeoutMs, millis()))
+      {
+        c = defaultValue;
+        return false;
+      }
+      c = readInput();
+      return true;
+    }
+
+    // Wait timeoutMs at most for a whole number. Returns false and sets
+    // result to defaultValue if it was not typed in time, the keys typed so
+    // far are lost then. The loop stalls for timeoutMs at most.
+    template <class T, class U>
+    static bool getNumber(T & result, const U defaultValue,
+                          const unsigned long timeoutMs,
+                          const char * const message = nullptr)
+    {
+      start();
+      if (message)
+      {
+        Serial.print(message);
+      }
+
+      T value = 0;
+      const bool complete = parseNumber(value, timeoutMs, millis());
+      if (!complete)
+      {
+        value = defaultValue;
+      }
+
+      if (message)
+      {
+        Serial.println(value);
+      }
+      result = value;
+      return complete;
+    }
+
+  private:
+    // Wait for a character until the timeout, see waitInput()
+    static inline bool nextInput(char & c, const unsigned long timeoutMs,
+                                 const unsigned long startMs)
+    {
+      if (!waitInput(timeoutMs, startMs))
+      {
+        return false;
+      }
+      c = readInput();
+      return true;
+    }
+
+    // Parse a number from the input. Returns false on timeout.
+    template <class T>
+    static bool parseNumber(T & value, const unsigned long timeoutMs,
+                            const unsigned long startMs)
+    {
+      bool isNegative = false;
       T decimals = 0;
+      char c = '0';
+      
+      // Skip the first invalid carriage return
+      if (!nextInput(c, timeoutMs, startMs))
+      {
+        return false;
+      }
+      if (c == 0x0A && !nextInput(c, timeoutMs, startMs))
+      {
+        return false;
+      }
+
+      if (c == '-')
+      {
+        isNegative = true;
+        if (!nextInput(c, timeoutMs, startMs))
+        {
+          return false;
+        }
+      }
+      
+      while ((c >= '0' and c <= '9') || c == '.')
+      {
+        decimals *= 10;
+
+        if (c >= '0' and c <= '9')
+        {
+          value = value * 10 + (c - '0');
+        }
+        else if (decimals == 0 && c == '.')
+        {
+          decimals = 1;
+        }
+
+        if (!nextInput(c, timeoutMs, startMs))
+        {
+          return false;
+        }
+      }
+      
+      if (isNegative)
+      {
+        value = -value;
+      }
       
+      if (decimals)
+      {
+        value /= decimals;
+      }
+      return true;
+    }
+
+  public:
+    // Read numbers separated by spaces, commas or line endings into an array,
+    // until it is full or a blank line is typed, and return how many were
+    // read. Lines end with \n, \r or \r\n. Numbers are parsed like
+    // getNumber(), as they arrive, and the sender is paced with XON/XOFF so a
+    // table pasted at full line rate doesn't overrun the receive buffer. Any
+    // other character, like the '-' of 1-2, ends the list without the number
+    // it is in. Once the array is full or the list ended on such a character
+    // the rest of the line is read and dropped, so it is not taken for menu
+    // keys.
+    // Note: this routine is blocking execution until the input is complete,
+    // or closed on the host
+    template <class T>
+    static SerialMenuSize getArray(T * array, SerialMenuSize count,
+                                   const char * const message = nullptr)
+    {
+      start();
+      const char XON = 0x11;
+      const char XOFF = 0x13;
+      bool paused = false;
+      SerialMenuSize read = 0;
+      // Number being parsed, if isNumber
+      bool isNumber = false;
+      bool hasDigits = false;
+      bool isNegative = false;
+      T value = 0;
+      T decimals = 0;
+      // Line endings in a row, with nothing else in between
+      uint8_t lineEnds = 0;
+      char c = '\n';
+      char previous = 0;
+
+      if (message)
+      {
+        Serial.print(message);
+      }
+
+      while (read < count)
+      {
+        // Pace the sender on the bytes waiting in the receive buffer
+        const int pending = Serial.available();
+        if (!paused && pending >= SERIALMENU_BULK_XOFF_LEVEL)
+        {
+          Serial.write(XOFF);
+          paused = true;
+        }
+        else if (paused && pending <= SERIALMENU_BULK_XON_LEVEL)
+        {
+          Serial.write(XON);
+          paused = false;
+        }
+
+        // The input closed ends the line, and the list
+        const bool isOpen = waitInput();
+        c = isOpen ? readInput() : '\n';
+
+        if (c >= '0' && c <= '9')
+        {
+          decimals *= 10;
+          value = value * 10 + (c - '0');
+          isNumber = true;
+          hasDigits = true;
+        }
+        else if (c == '.' && decimals == 0)
+        {
+          decimals = 1;
+          isNumber = true;
+        }
+        else if (c == '-' && !isNumber)
+        {
+          isNegative = true;
+          isNumber = true;
+        }
+        else if (c == ' ' || c == '\t' || c == ',' || c == '\r' || c == '\n')
+        {
+          if (isNumber)
+          {
+            // A sign or a point alone is not a number, and ends the list
+            if (!hasDigits)
+            {
+              break;
+            }
+            if (isNegative)
+            {
+              value = -value;
+            }
+            if (decimals)
+            {
+              value /= decimals;
+            }
+            array[read++] = value;
+            isNumber = false;
+            hasDigits = false;
+            isNegative = false;
+            value = 0;
+            decimals = 0;
+            lineEnds = 0;
+          }
+          // A line ends with \n, \r or \r\n
+          if (c == '\r' || (c == '\n' && previous != '\r'))
+          {
+            if (++lineEnds == 2)
+            {
+              break;
+            }
+          }
+        }
+        else
+        {
+          // Anything else, like the '-' of 1-2 or a second point, ends the
+          // list without the number it is in
+          break;
+        }
+        if (!isOpen)
+        {
+          break;
+        }
+        previous = c;
+      }
+
+      if (paused)
+      {
+        Serial.write(XON);
+      }
+      // Full or stopped before the end of the line: drop the rest of it
+      while (c != '\n' && c != '\r' && waitInput())
+      {
+        c = readInput();
+      }
       if (message)
       {
-        Serial.print(message);
+        Serial.println(read);
+      }
+      return read;
+    }
+
+    // Non-blocking getChar(): returns false if there is no input yet,
+    // otherwise sets c and returns true.
+    static inline bool pollChar(char & c)
+    {
+      if (!inputAvailable())
+      {
+        return false;
+      }
+      c = readInput();
+      return true;
+    }
+
+    // Non-blocking getNumber(): consumes the input available, and returns
+    // false until a whole number was typed. Then it sets result and returns
+    // true. The number being parsed is kept in the menu's state, so only one
+    // number can be read at a time.
+    template <class T>
+    static bool pollNumber(T & result, const char * const message = nullptr)
+    {
+      static_assert(sizeof(T) <= sizeof(PollNumber::value),
+                    "pollNumber() type bigger than 8 bytes");
+      PollNumber & p = pollState();
+      T value;
+      T decimals;
+
+      // 0: not started, 1: skip a carriage return, 2: sign, 3: digits
+      if (p.state == 0)
+      {
+        if (message)
+        {
+          Serial.print(message);
+        }
+        value = 0;
+        decimals = 0;
+        p.isNegative = false;
+        p.state = 1;
+      }
+      else
+      {
+        memcpy(&value, p.value, sizeof(T));
+        memcpy(&decimals, p.decimals, sizeof(T));
+      }
+
+      while (inputAvailable())
+      {
+        const char c = readInput();
+
+        // Same parsing as getNumber()
+        if (p.state == 1)
+        {
+          p.state = 2;
+          if (c == 0x0A)
+          {
+            continue;
+          }
+        }
+        if (p.state == 2)
+        {
+          p.state = 3;
+          if (c == '-')
+          {
+            p.isNegative = true;
+            continue;
+          }
+        }
+
+        if (c >= '0' and c <= '9')
+        {
+          decimals *= 10;
+          value = value * 10 + (c - '0');
+        }
+        else if (c == '.')
+        {
+          decimals *= 10;
+          if (decimals == 0)
+          {
+            decimals = 1;
+          }
+        }
+        else
+        {
+          if (p.isNegative)
+          {
+            value = -value;
+          }
+          if (decimals)
+          {
+            value /= decimals;
+          }
+          if (message)
+          {
+            Serial.println(value);
+          }
+          p.state = 0;
+          result = value;
+          return true;
+        }
+      }
+
+      memcpy(p.value, &value, sizeof(T));
+      memcpy(p.decimals, &decimals, sizeof(T));
+      return false;
+    }
+
+    // Called by an async callback that needs more input: run() resumes the
+    // callback instead of reading a menu choice once there is input.
+    // Use the SERIALMENU_AWAIT_*() macros rather than calling it directly.
+    static inline void await()
+    {
+      resumeCallback = runningCallback;
+    }
+
+    // True while an async callback waits for input
+    static inline bool isAwaiting()
+    {
+      return resumeCallback != nullptr;
+    }
+
+    #if SERIALMENU_ENABLE_ASYNC_CALLBACKS == true
+    // Where the async callback resumes. Only one callback awaits at a time,
+    // so they all share it. Used by the SERIALMENU_*_ASYNC() macros.
+    static inline uint16_t & asyncLine()
+    {
+      return resumeLine;
+    }
+    #endif
+
+    #if SERIALMENU_ENABLE_IDLE_HOOK == true
+    // Set the function called while getChar(), getNumber() or getArray()
+    // wait for input, or nullptr for none. This also resets the longest gap.
+    // The hook must not read the Serial console.
+    static inline void setIdleHook(void (*hook)())
+    {
+      idle().hook = hook;
+      idle().maxGapUs = 0;
+    }
+
+    // Longest time between two idle hook calls while waiting for input, in
+    // microseconds, counted from the start of the wait for the first call
+    static inline unsigned long getIdleMaxGapUs()
+    {
+      return idle().maxGapUs;
+    }
+    #endif
+
+    #if SERIALMENU_ENABLE_INPUT_STATS == true
+    // Input counters since the start or the last resetInputStats()
+    static inline const SerialMenuInputStats & getInputStats()
+    {
+      return inputStats();
+    }
+
+    static inline void resetInputStats()
+    {
+      inputStats() = SerialMenuInputStats();
+    }
+    #endif
+
+  private:
+    // Call a menu entry's callback
+    static inline void dispatch(void (*callback)())
+    {
+      #if SERIALMENU_ENABLE_ASYNC_CALLBACKS == true
+      resumeCallback = nullptr;
+      runningCallback = callback;
+      #endif
+      callback();
+    }
+
+    // Call the callback of the menu entry chosen with key
+    static inline void dispatch(const SerialMenuEntry & entry, const char key)
+    {
+      #if SERIALMENU_ENABLE_INPUT_STATS == true && SERIALMENU_TYPEAHEAD_LIMIT > 0
+      // Input waiting and bytes read, to find the keys typed meanwhile
+      const int waiting = Serial.available();
+      const uint32_t read = inputStats().bytes;
+      call(entry, key);
+      dropTypeahead(waiting - int(inputStats().bytes - read));
+      #else
+      call(entry, key);
+      #endif
+    }
+
+    static inline void call(const SerialMenuEntry & entry, const char key)
+    {
+      #if SERIALMENU_CALLBACK_ARGUMENTS == true
+      if (entry.hasArgument())
+      {
+        // Only callbacks without arguments can be resumed, these don't await
+        #if SERIALMENU_ENABLE_ASYNC_CALLBACKS == true
+        resumeCallback = nullptr;
+        runningCallback = nullptr;
+        #endif
+        entry.select(key);
+        return;
+      }
+      #endif
+      (void) key;
+      #if SERIALMENU_ENABLE_ASYNC_CALLBACKS == true
+      // A callback chosen from the menu starts from its beginning
+      resumeLine = 0;
+      #endif
+      dispatch(entry.actionCallback);
+    }
+
+  public:
+
+    #if SERIALMENU_ENABLE_WATCHES == true
+    // Print the variables of a watch list every periodMs from run(), one
+    // per line. The watches are spread evenly over the period. Pass a null
+    // list to stop watching.
+    static void watch(const SerialMenuWatch * list, uint8_t count,
+                      uint16_t periodMs)
+    {
+      watches.list = list;
+      watches.count = list ? count : 0;
+      watches.next = 0;
+      watches.intervalMs = count ? periodMs / count : 0;
+      watches.lastMs = millis();
+      watches.dueMs = watches.lastMs;
+      watches.budget = 0;
+    }
+    #endif
+
+  private:
+    #if SERIALMENU_ENABLE_WATCHES == true
+    // Bytes per second watches may use: 10 bits per byte on the line
+    static constexpr int32_t WATCH_BYTES_PER_SECOND =
+      int32_t(SERIALMENU_BAUD_RATE) / 10 * SERIALMENU_WATCH_BANDWIDTH_PERCENT
+      / 100;
+    // Budget saved while idle, in 1/1000th of bytes: a couple of lines
+    static constexpr int32_t WATCH_MAX_BUDGET = 64 * 1000L;
+
+    // Print the watch that is due, if the bandwidth budget allows it
+    static void refreshWatches()
+    {
+      if (!watches.count)
+      {
+        return;
+      }
+      #if SERIALMENU_ENABLE_ASYNC_CALLBACKS == true
+      // Don't break the line of a callback prompting for input
+      if (isAwaiting())
+      {
+        return;
+      }
+      #endif
+
+      // Earn budget for the time elapsed (bytes/s * ms = 1/1000th bytes)
+      const uint16_t now = millis();
+      watches.budget += int32_t(uint16_t(now - watches.lastMs))
+                        * WATCH_BYTES_PER_SECOND;
+      if (watches.budget > WATCH_MAX_BUDGET)
+      {
+        watches.budget = WATCH_MAX_BUDGET;
+      }
+      watches.lastMs = now;
+
+      // Not due yet, or the last prints used more than their share
+      if (int16_t(now - watches.dueMs) < 0 || watches.budget < 0)
+      {
+        return;
+      }
+
+      const SerialMenuWatch & w = watches.list[watches.next];
+      size_t printed = print(w.label, w.isProgMem);
+      printed += w.format(w.variable);
+      printed += Serial.println("");
+      watches.budget -= int32_t(printed) * 1000;
+
+      if (++watches.next == watches.count)
+      {
+        watches.next = 0;
+      }
+      watches.dueMs += watches.intervalMs;
+      // Late by more than a round: don't print in bursts to catch up
+      if (int16_t(now - watches.dueMs) > int16_t(watches.intervalMs))
+      {
+        watches.dueMs = now;
+      }
+    }
+    #endif
+
+    #if SERIALMENU_ENABLE_PERSISTENCE == true
+    // The EEPROM log is made of slots, each holding a record of one value:
+    // - a header: the generation bit of the pass that wrote it, and the index
+    //   of the value. 0xFF, the erased EEPROM value, marks an empty slot.
+    // - the value's bytes
+    // - a checksum, so a record torn by a reset while writing is ignored
+    // A pass writes the slots in order and flips the generation bit, so the
+    // next slot to write is where the generation bit changes.
+    static constexpr uint8_t PERSIST_SLOT_BYTES =
+      SERIALMENU_PERSIST_MAX_SIZE + 2;
+    static constexpr uint16_t PERSIST_SLOTS =
+      SERIALMENU_PERSIST_EEPROM_SIZE / PERSIST_SLOT_BYTES;
+    static_assert(SERIALMENU_PERSIST_MAX_VALUES < PERSIST_SLOTS &&
+                  PERSIST_SLOTS < 0xFF && SERIALMENU_PERSIST_MAX_VALUES < 0x80,
+                  "The EEPROM log needs more slots than values, 254 at most");
+
+    // Values saved, which ones changed, and where the log is at
+    struct Persist
+    {
+      const SerialMenuValue * list;
+      uint8_t count;
+      uint8_t dirty[(SERIALMENU_PERSIST_MAX_VALUES + 7) / 8];
+      // Slot of the latest record of each value, 0xFF if there is none
+      uint8_t slot[SERIALMENU_PERSIST_MAX_VALUES];
+      // Next slot to write, and the generation bit of this pass
+      uint8_t head;
+      uint8_t generation;
+      uint16_t changedMs;
+    };
+
+    static inline Persist & persistState()
+    {
+      static Persist state;
+      return state;
+    }
+
+    static inline uint16_t persistAddress(uint8_t slot)
+    {
+      return SERIALMENU_PERSIST_EEPROM_ADDRESS + slot * PERSIST_SLOT_BYTES;
+    }
+
+    static uint8_t persistCheck(uint16_t address, uint8_t header, uint8_t size)
+    {
+      uint8_t check = header ^ 0x5A;
+      for (uint8_t i = 0; i < size; ++i)
+      {
+        check = uint8_t((check << 1) | (check >> 7))
+              ^ EEPROM.read(address + 1 + i);
+      }
+      return check;
+    }
+
+    static bool isDirty()
+    {
+      const Persist & p = persistState();
+      for (uint8_t i = 0; i < sizeof(p.dirty); ++i)
+      {
+        if (p.dirty[i])
+        {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // Write one changed value to the log. Returns false if there is none.
+    // Records are only appended at the head, which never holds the latest
+    // record of a value, so a write torn by a reset loses no saved value.
+    static bool persistWrite()
+    {
+      Persist & p = persistState();
+      uint8_t i = 0;
+      while (i < p.count && !(p.dirty[i / 8] & (1 << (i % 8))))
+      {
+        ++i;
+      }
+      if (i == p.count)
+      {
+        return false;
+      }
+
+      // The head moves to the next slot: if that slot holds the latest record
+      // of a value, append that value first so that its record there is
+      // older. There are more slots than values, so the changed value's turn
+      // comes.
+      const uint8_t next = (p.head + 1 == PERSIST_SLOTS) ? 0 : p.head + 1;
+      for (uint8_t j = 0; j < p.count; ++j)
+      {
+        if (p.slot[j] == next)
+        {
+          i = j;
+          break;
+        }
+      }
+
+      // Write the value, or copy its record if it didn't change. The header
+      // is written last: until then the slot is not the head's.
+      const SerialMenuValue & v = p.list[i];
+      const bool isDirty = p.dirty[i / 8] & (1 << (i % 8));
+      const uint16_t from = persistAddress(p.slot[i]);
+      const uint16_t address = persistAddress(p.head);
+      const uint8_t header = p.generation | i;
+      for (uint8_t b = 0; b < v.size; ++b)
+      {
+        EEPROM.update(address + 1 + b,
+                      isDirty ? ((const uint8_t *) v.variable)[b]
+                              : EEPROM.read(from + 1 + b));
+      }
+      EEPROM.update(address + 1 + SERIALMENU_PERSIST_MAX_SIZE,
+                    persistCheck(address, header, v.size));
+      EEPROM.update(address, header);
+
+      // The record is complete, the older one can be dropped
+      p.slot[i] = p.head;
+      p.dirty[i / 8] &= ~(1 << (i % 8));
+      p.head = next;
+      if (!next)
+      {
+        p.generation ^= 0x80;
+      }
+      return true;
+    }
+
+    // Save a change once the user is done changing values
+    static void persistIdle()
+    {
+      if (uint16_t(uint16_t(millis()) - persistState().changedMs) >=
+          SERIALMENU_PERSIST_DELAY_MS && isDirty())
+      {
+        persistWrite();
+      }
+    }
+    #endif
+
+  public:
+    #if SERIALMENU_ENABLE_PERSISTENCE == true
+    // Restore the variables of the list from EEPROM, and save them from now
+    // on. Variables never saved keep their value.
+    static void persist(const SerialMenuValue * list, uint8_t count)
+    {
+      Persist & p = persistState();
+      p.list = list;
+      p.count = count;
+      memset(p.dirty, 0, sizeof(p.dirty));
+      memset(p.slot, 0xFF, sizeof(p.slot));
+
+      // Find the head: the first slot empty or of another pass than slot 0
+      const uint8_t first = EEPROM.read(persistAddress(0));
+      p.generation = (first == 0xFF) ? 0 : (first & 0x80);
+      for (p.head = 0; p.head < PERSIST_SLOTS; ++p.head)
+      {
+        const uint8_t header = EEPROM.read(persistAddress(p.head));
+        if (header == 0xFF || (header & 0x80) != p.generation)
+        {
+          break;
+        }
+      }
+      if (p.head == PERSIST_SLOTS)
+      {
+        p.head = 0;
+        p.generation ^= 0x80;
+      }
+
+      // Read the records from the oldest, at the head, to the newest
+      for (uint8_t n = 0; n < PERSIST_SLOTS; ++n)
+      {
+        const uint8_t slot = (p.head + n) % PERSIST_SLOTS;
+        const uint16_t address = persistAddress(slot);
+        const uint8_t header = EEPROM.read(address);
+        const uint8_t i = header & 0x7F;
+        if (header == 0xFF || i >= count ||
+            EEPROM.read(address + 1 + SERIALMENU_PERSIST_MAX_SIZE) !=
+              persistCheck(address, header, list[i].size))
+        {
+          continue;
+        }
+        for (uint8_t b = 0; b < list[i].size; ++b)
+        {
+          ((uint8_t *) list[i].variable)[b] = EEPROM.read(address + 1 + b);
+        }
+        p.slot[i] = slot;
+      }
+    }
+
+    // Tell that this variable of the list changed
+    template <class T>
+    static void changed(const T & variable)
+    {
+      Persist & p = persistState();
+      for (uint8_t i = 0; i < p.count; ++i)
+      {
+        if (p.list[i].variable == &variable)
+        {
+          p.dirty[i / 8] |= 1 << (i % 8);
+          p.changedMs = millis();
+          return;
+        }
+      }
+    }
+
+    // Save all the changes now, for example from a "save" menu entry
+    static void save()
+    {
+      while (persistWrite());
+    }
+    #endif
+
+  private:
+    #if SERIALMENU_ENABLE_SEARCH == true
+    static_assert(SERIALMENU_SEARCH_MAX_LENGTH <= 32,
+                  "Search text is 32 characters at most");
+
+    // Search in progress: the text typed, and a bit per entry found
+    struct Search
+    {
+      bool active;
+      uint8_t length;
+      char text[SERIALMENU_SEARCH_MAX_LENGTH];
+      uint8_t found[(SERIALMENU_SEARCH_MAX_ENTRIES + 7) / 8];
+    };
+
+    static inline Search & search()
+    {
+      static Search state;
+      return state;
+    }
+
+    // Number of entries searched
+    static inline SerialMenuSize searchSize()
+    {
+      return (size < SERIALMENU_SEARCH_MAX_ENTRIES)
+           ? size : SERIALMENU_SEARCH_MAX_ENTRIES;
+    }
+
+    // Check if the entry's message contains the search text. The message is
+    // streamed once through a shift-and matcher: bit i of state is set when
+    // the last i+1 characters read match the start of the text.
+    static bool matches(const SerialMenuEntry & entry)
+    {
+      const Search & s = search();
+      if (!s.length)
+      {
+        return true;
+      }
+      const uint32_t done = uint32_t(1) << (s.length - 1);
+      uint32_t state = 0;
+      MessageReader reader(entry.getMenu(), entry.isProgMem());
+
+      for (char c; (c = reader.next());)
+      {
+        c = SerialMenuEntry::toLower(c);
+        uint32_t mask = 0;
+        for (uint8_t i = 0; i < s.length; ++i)
+        {
+          mask |= uint32_t(s.text[i] == c) << i;
+        }
+        state = ((state << 1) | 1) & mask;
+        if (state & done)
+        {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // Keep the entries found which still match. A longer text can only
+    // match entries that matched before, so only those are checked.
+    static void searchFilter(bool restart)
+    {
+      Search & s = search();
+      const SerialMenuSize n = searchSize();
+      for (SerialMenuSize i = 0; i < n; ++i)
+      {
+        uint8_t & byte = s.found[i / 8];
+        const uint8_t bit = 1 << (i % 8);
+        if ((restart || (byte & bit)) && matches(entry(i)))
+        {
+          byte |= bit;
+        }
+        else
+        {
+          byte &= ~bit;
+        }
+      }
+    }
+
+    // Print the search text, how many entries it finds, and the first few
+    // of them. Returns the index of the first entry found, or size.
+    static SerialMenuSize searchShow()
+    {
+      const Search & s = search();
+      const SerialMenuSize n = searchSize();
+      SerialMenuSize count = 0;
+      SerialMenuSize first = size;
+      for (SerialMenuSize i = 0; i < n; ++i)
+      {
+        if (s.found[i / 8] & (1 << (i % 8)))
+        {
+          first = (count++) ? first : i;
+        }
+      }
+
+      Serial.print(SERIALMENU_SEARCH_KEY);
+      Serial.write((const char *) s.text, s.length);
+      Serial.print(" (");
+      Serial.print(count);
+      Serial.println(")");
+      if (count <= SERIALMENU_SEARCH_MAX_SHOWN)
+      {
+        for (SerialMenuSize i = first; i < n; ++i)
+        {
+          if (s.found[i / 8] & (1 << (i % 8)))
+          {
+            print(entry(i));
+            Serial.println("");
+          }
+        }
+      }
+      return first;
+    }
+
+    // Handle a key for the search. Returns false if it is a menu choice.
+    static bool searchKey(char c)
+    {
+      Search & s = search();
+      if (!s.active)
+      {
+        if (c != SERIALMENU_SEARCH_KEY)
+        {
+          return false;
+        }
+        s.active = true;
+        s.length = 0;
+        if (size > SERIALMENU_SEARCH_MAX_ENTRIES)
+        {
+          // Don't let the user believe the other entries didn't match
+          Serial.print("Searching the first ");
+          Serial.print(SERIALMENU_SEARCH_MAX_ENTRIES);
+          Serial.print(" of ");
+          Serial.print(size);
+          Serial.println(" entries");
+        }
+        searchFilter(true);
+        searchShow();
+        return true;
       }
-      char c = '0';
-      
-      // Skip the first invalid carriage return
-      while (!Serial.available());
-      c = Serial.read();
-      if (c == 0x0A)
+
+      if (c == 0x1B)
       {
-        while (!Serial.available());
-        c = Serial.read();
+        // Escape: back to the menu
+        s.active = false;
+      }
+      else if (c == 0x0A || c == 0x0D)
+      {
+        // Enter: run the first entry found
+        s.active = false;
+        const SerialMenuSize first = searchShow();
+        if (first < size)
+        {
+          const SerialMenuEntry & chosen = entry(first);
+          #if SERIALMENU_ENABLE_KEY_SETS == true
+          dispatch(chosen, chosen.getKey());
+          #else
+          dispatch(chosen, 0);
+          #endif
+        }
+      }
+      else if (c == 0x08 || c == 0x7F)
+      {
+        // Backspace: a shorter text matches more, search all entries again
+        if (s.length)
+        {
+          --s.length;
+        }
+        searchFilter(true);
+        searchShow();
+      }
+      else if (s.length < SERIALMENU_SEARCH_MAX_LENGTH && c >= ' ')
+      {
+        s.text[s.length++] = SerialMenuEntry::toLower(c);
+        searchFilter(false);
+        searchShow();
       }
+      return true;
+    }
+    #endif
 
-      if (c == '-')
+  private:
+    #if SERIALMENU_ENABLE_MACROS == true
+    // EEPROM layout of a macro: its name, its length, then its keys.
+    // A name of 0xFF, the erased EEPROM value, marks a free slot.
+    static constexpr uint16_t MACRO_BYTES = SERIALMENU_MACRO_MAX_KEYS + 2;
+
+    // EEPROM address of the macro with this name, else of a free slot if
+    // asked for one. Returns 0xFFFF if there is none.
+    static uint16_t macroFind(char name, bool orFree)
+    {
+      uint16_t found = 0xFFFF;
+      for (uint8_t i = 0; i < SERIALMENU_MACRO_SLOTS; ++i)
       {
-        isNegative = true;
-        while (!Serial.available());
-        c = Serial.read();
+        const uint16_t address = SERIALMENU_MACRO_EEPROM_ADDRESS
+                               + i * MACRO_BYTES;
+        const uint8_t slotName = EEPROM.read(address);
+        if (slotName == uint8_t(name))
+        {
+          return address;
+        }
+        if (orFree && slotName == 0xFF && found == 0xFFFF)
+        {
+          found = address;
+        }
       }
-      
-      while ((c >= '0' and c <= '9') || c == '.')
+      return found;
+    }
+
+    // Save the macro recorded. An empty macro deletes the one of that name.
+    // update() only writes the bytes that changed, and the name is written
+    // last, so a reset while saving loses the new macro but nothing else.
+    static void macroSave()
+    {
+      const Macro & m = macro();
+      const uint16_t address = macroFind(m.recording, m.length);
+      if (address == 0xFFFF)
       {
-        decimals *= 10;
+        if (m.length)
+        {
+          Serial.println("No macro slot left.");
+        }
+        return;
+      }
+      for (uint8_t i = 0; i < m.length; ++i)
+      {
+        EEPROM.update(address + 2 + i, m.keys[i]);
+      }
+      EEPROM.update(address + 1, m.length);
+      EEPROM.update(address, m.length ? uint8_t(m.recording) : 0xFF);
+    }
 
-        if (c >= '0' and c <= '9')
+    // Handle the macro keys. Returns false if c is a menu choice.
+    bool macroKey(char c, const uint16_t loopDelayMs)
+    {
+      Macro & m = macro();
+      if (m.playing)
+      {
+        return false;
+      }
+
+      if (m.command)
+      {
+        // c names the macro to record or play
+        const char command = m.command;
+        m.command = 0;
+        if (command == SERIALMENU_MACRO_RECORD_KEY)
         {
-          value = value * 10 + (c - '0');
+          m.recording = c;
+          m.length = 0;
+          m.overflow = false;
+          Serial.print("Recording macro ");
+          Serial.println(c);
+          return true;
         }
-        else if (decimals == 0 && c == '.')
+
+        // Playing a macro while recording records the keys it plays
+        if (m.recording && !m.overflow)
         {
-          decimals = 1;
+          m.length -= 2;
+        }
+        const uint16_t address = macroFind(c, false);
+        if (address == 0xFFFF)
+        {
+          Serial.print(c);
+          Serial.println(": No such macro.");
+          return true;
         }
+        // Run the keys one after the other, then show where they lead
+        m.playAddress = address + 2;
+        m.playLeft = EEPROM.read(address + 1);
+        m.playing = true;
+        while (m.playLeft)
+        {
+          run(loopDelayMs);
+        }
+        m.playing = false;
+        show();
+        return true;
+      }
 
-        while (!Serial.available());
-        c = Serial.read();
+      if (c == SERIALMENU_MACRO_RECORD_KEY && m.recording)
+      {
+        // The key stopping the recording is not part of the macro
+        if (m.overflow)
+        {
+          Serial.println("Macro too long, not saved.");
+        }
+        else
+        {
+          --m.length;
+          macroSave();
+          Serial.print("Saved macro ");
+          Serial.println(m.recording);
+        }
+        m.recording = 0;
+        return true;
       }
-      
-      if (isNegative)
+
+      if (c == SERIALMENU_MACRO_RECORD_KEY || c == SERIALMENU_MACRO_PLAY_KEY)
       {
-        value = -value;
+        m.command = c;
+        return true;
       }
-      
-      if (decimals)
+      return false;
+    }
+    #endif
+
+  public:
+    #if SERIALMENU_ENABLE_EXPORT == true
+  private:
+    // Print a message as a JSON string
+    static void printJson(const char * message, bool isProgMem)
+    {
+      Serial.print('"');
+      MessageReader reader(message, isProgMem);
+      for (char c; (c = reader.next());)
       {
-        value /= decimals;
+        if (c == '"' || c == '\\')
+        {
+          Serial.print('\\');
+          Serial.print(c);
+        }
+        else if (uint8_t(c) < 0x20 || uint8_t(c) >= 0x80)
+        {
+          // Control characters, and bytes which may not be UTF-8
+          Serial.print("\\u00");
+          Serial.print("0123456789abcdef"[uint8_t(c) >> 4]);
+          Serial.print("0123456789abcdef"[c & 0x0F]);
+        }
+        else
+        {
+          Serial.print(c);
+        }
       }
-      
-      if (message)
+      Serial.print('"');
+    }
+
+    // Print a menu entry as JSON, on its own line
+    static void exportEntry(const char * type, SerialMenuSize index,
+                            const SerialMenuEntry & e)
+    {
+      Serial.print("{\"type\":\"");
+      Serial.print(type);
+      Serial.print("\",\"index\":");
+      Serial.print(index);
+      #if SERIALMENU_ENABLE_KEY_SETS == true
+      if (e.getKeys())
       {
-        Serial.println(value);
+        Serial.print(",\"keys\":");
+        printJson(e.getKeys(), false);
       }
-      return value;
+      else
+      #endif
+      {
+        const char key[] = {e.getKey(), 0};
+        Serial.print(",\"key\":");
+        printJson(key, false);
+      }
+      Serial.print(",\"label\":");
+      printJson(e.getMenu(), e.isProgMem());
+      Serial.println("}");
+    }
+
+    #if SERIALMENU_ENABLE_WATCHES == true
+    // Print a watched number as JSON, from its kind and size in bytes
+    static void exportNumber(const void * v, uint8_t kind, uint8_t bytes)
+    {
+      if (kind == SerialMenuWatch::FLOAT)
+      {
+        const double d = (bytes == sizeof(float)) ? *(const float *) v
+                                                  : *(const double *) v;
+        // Not a number, infinite, or too big to print: no JSON number
+        if (d >= -4294967040.0 && d <= 4294967040.0)
+        {
+          Serial.print(d);
+        }
+        else
+        {
+          Serial.print("null");
+        }
+        return;
+      }
+
+      unsigned long n;
+      switch (bytes)
+      {
+        case 1:  n = *(const uint8_t *) v; break;
+        case 2:  n = *(const uint16_t *) v; break;
+        case 4:  n = *(const uint32_t *) v; break;
+        default: n = *(const unsigned long *) v; break;
+      }
+      if (kind == SerialMenuWatch::SIGNED)
+      {
+        // Extend the sign of the smaller types
+        const uint8_t shift = 8 * (sizeof(long) - bytes);
+        Serial.print(long(n << shift) >> shift);
+      }
+      else
+      {
+        Serial.print(n);
+      }
+    }
+    #endif
+
+  public:
+    // Print the current menu and the variables watched as JSON, one object
+    // per line, straight from the menu tables:
+    // {"type":"menu","entries":2}
+    // {"type":"entry","index":0,"key":"x","label":"update [X]"}
+    // {"type":"entry","index":1,"keys":"0-9","label":"0-9 - channel"}
+    // {"type":"global","index":0,"key":"m","label":"M - Menu"}
+    // {"type":"watch","index":0,"label":"y = ","format":"u16","value":12}
+    // {"type":"end"}
+    // Sub-menus are loaded by callbacks the export can't see into: send the
+    // key of a sub-menu, then the export key, to read it.
+    static void exportJson()
+    {
+      updateSize();
+      Serial.print("{\"type\":\"menu\",\"entries\":");
+      Serial.print(size);
+      Serial.println("}");
+
+      for (SerialMenuSize i = 0; i < size; ++i)
+      {
+        exportEntry("entry", i, entry(i));
+      }
+      #if SERIALMENU_ENABLE_GLOBAL_MENU == true
+      for (SerialMenuSize i = 0; i < globalSize; ++i)
+      {
+        exportEntry("global", i, globalMenu[i]);
+      }
+      #endif
+
+      #if SERIALMENU_ENABLE_WATCHES == true
+      for (uint8_t i = 0; i < watches.count; ++i)
+      {
+        const SerialMenuWatch & w = watches.list[i];
+        Serial.print("{\"type\":\"watch\",\"index\":");
+        Serial.print(i);
+        Serial.print(",\"label\":");
+        printJson(w.label, w.isProgMem);
+        Serial.print(",\"format\":\"");
+        const uint8_t kind = w.type & 0xF0;
+        const uint8_t bytes = w.type & 0x0F;
+        switch (kind)
+        {
+          case SerialMenuWatch::UNSIGNED: Serial.print('u'); break;
+          case SerialMenuWatch::SIGNED:   Serial.print('i'); break;
+          case SerialMenuWatch::FLOAT:    Serial.print('f'); break;
+          case SerialMenuWatch::BOOL:     Serial.print("bool"); break;
+          case SerialMenuWatch::TEXT:     Serial.print("text"); break;
+          default:                        Serial.print('?'); break;
+        }
+        if (kind == SerialMenuWatch::UNSIGNED ||
+            kind == SerialMenuWatch::SIGNED ||
+            kind == SerialMenuWatch::FLOAT)
+        {
+          Serial.print(bytes * 8);
+        }
+        Serial.print("\",\"value\":");
+        if (kind == SerialMenuWatch::TEXT)
+        {
+          printJson(*(const char * const *) w.variable, false);
+        }
+        else if (kind == SerialMenuWatch::BOOL)
+        {
+          Serial.print(*(const bool *) w.variable ? "true" : "false");
+        }
+        else if (kind == SerialMenuWatch::UNKNOWN)
+        {
+          // The formatter prints straight to Serial, where its text can't
+          // be escaped
+          Serial.print("null");
+        }
+        else
+        {
+          exportNumber(w.variable, kind, bytes);
+        }
+        Serial.println("}");
+      }
+      #endif
+      Serial.println("{\"type\":\"end\"}");
     }
+    #endif
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -439,7 +3559,18 @@ class SerialMenu
     // Returns false if there was no menu input, true if there was
     bool run(const uint16_t loopDelayMs)
     {
-      const bool userInputAvailable = Serial.available();
+      start();
+      #if SERIALMENU_ENABLE_INPUT_STATS == true
+      // Not while an async callback waits for input typed ahead on purpose
+      #if SERIALMENU_ENABLE_ASYNC_CALLBACKS == true
+      if (!resumeCallback)
+      #endif
+      {
+        inputCheck();
+      }
+      #endif
+
+      const bool userInputAvailable = inputAvailable();
 
       // Code block to display a heartbeat as a dot on the Serial console and
       // also by blinking the status LED on the board.
@@ -456,7 +3587,9 @@ class SerialMenu
           // After waiting for 10s, heartbeat blink the LED every second.
           if (waiting >= loopsPerTick && waiting % loopsPerBlink == 0)
           {
+            #if SERIALMENU_TIMER_HEARTBEAT != true
             digitalWrite(LED_BUILTIN, ((waiting / loopsPerBlink) & 0x01) ? HIGH : LOW);
+            #endif
          }
           // Print heartbeat every 10s on console.
           if (waiting % loopsPerTick == 0)
@@ -474,17 +3607,77 @@ class SerialMenu
           }
         }
       }
+      #else
+      // No LED to blink, as on the host: the loop's period is not needed
+      (void) loopDelayMs;
+      #endif
+
+      #if SERIALMENU_TIMER_HEARTBEAT == true
+      // Start the timer when there is no input, stop it when there is some
+      if (userInputAvailable == heartbeat().armed)
+      {
+        if (userInputAvailable)
+        {
+          heartbeatDisarm();
+        }
+        else
+        {
+          heartbeatArm();
+        }
+      }
       #endif
 
       // Process the input
       if (!userInputAvailable)
       {
+        #if SERIALMENU_ENABLE_WATCHES == true
+        refreshWatches();
+        #endif
+        #if SERIALMENU_ENABLE_PERSISTENCE == true
+        persistIdle();
+        #endif
         return false;
       }
       else
       {
+        #if SERIALMENU_ENABLE_ASYNC_CALLBACKS == true
+        // An async callback waits for this input, resume it
+        if (resumeCallback)
+        {
+          dispatch(resumeCallback);
+          return true;
+        }
+        #endif
+
+        updateSize();
+        checkMenu();
+
         // Read one character from the Serial console as a menu choice.
-        char menuChoice = Serial.read();
+        char menuChoice = readInput();
+
+        #if SERIALMENU_ENABLE_EXPORT == true
+        if (menuChoice == SERIALMENU_EXPORT_KEY)
+        {
+          exportJson();
+          return true;
+        }
+        #endif
+
+        #if SERIALMENU_ENABLE_MACROS == true
+        // Keys recording or replaying macros are not menu choices
+        if (macroKey(menuChoice, loopDelayMs))
+        {
+          return true;
+        }
+        #endif
+
+        #if SERIALMENU_ENABLE_SEARCH == true
+        // Keys typed in a search are not menu choices
+        if (searchKey(menuChoice))
+        {
+          return true;
+        }
+        #endif
         
         // Carriage return is not a menu choice
         if (menuChoice == 0x0A)
@@ -492,16 +3685,49 @@ class SerialMenu
           return false;
         }
        
-        uint8_t i;
-        for (i = 0; i < size; ++i)
+        #if SERIALMENU_PAGE_SIZE > 0
+        // Page keys of a paged menu
+        if (size > SERIALMENU_PAGE_SIZE &&
+            (menuChoice == SERIALMENU_PAGE_NEXT_KEY ||
+             menuChoice == SERIALMENU_PAGE_PREV_KEY))
+        {
+          const SerialMenuSize pages = pageCount();
+          page = (menuChoice == SERIALMENU_PAGE_NEXT_KEY)
+               ? (page + 1) % pages
+               : (page + pages - 1) % pages;
+          show();
+          return true;
+        }
+        #endif
+
+        #if SERIALMENU_ENABLE_GLOBAL_MENU == true
+        // Global keys come first, and most keys are not global
+        if (isGlobal(menuChoice))
         {
-          if (menu[i].isChosen(menuChoice))
+          for (SerialMenuSize g = 0; g < globalSize; ++g)
           {
-            menu[i].actionCallback();
+            if (globalMenu[g].isChosen(menuChoice))
+            {
+              dispatch(globalMenu[g], menuChoice);
+              return true;
+            }
+          }
+        }
+        #endif
+
+        // Only the entries of the page shown can be chosen
+        const SerialMenuSize end = pageEnd();
+        SerialMenuSize i;
+        for (i = pageBegin(); i < end; ++i)
+        {
+          const SerialMenuEntry & choice = entry(i);
+          if (choice.isChosen(menuChoice))
+          {
+            dispatch(choice, menuChoice);
             break;
           }
         }
-        if (i == size)
+        if (i == end)
         {
           Serial.print(menuChoice);
           Serial.println(": Invalid menu choice.");
@@ -510,4 +3736,206 @@ class SerialMenu
       }
     }
 
-};
\ No newline at end of file
+    #ifdef SERIALMENU_TTY
+    ///////////////////////////////////////////////////////////////////////////
+    // Host only: the state of the menu for one user. A server serving many
+    // users at once saves the state of the user it served, and restores the
+    // state of the next one, see SerialMenuServer.hpp. This covers the
+    // current menu and the input in progress: an async callback waiting, a
+    // number being typed, a search, a macro and the ANSI screen drawn.
+    ///////////////////////////////////////////////////////////////////////////
+    struct Session
+    {
+      const SerialMenuEntry * menu;
+      SerialMenuSize size;
+      SerialMenuSize page;
+      #if SERIALMENU_ENABLE_GENERATED_MENUS == true
+      SerialMenuEntry (*generator)(SerialMenuSize index);
+      SerialMenuSize (*counter)();
+      #endif
+      #if SERIALMENU_ENABLE_ASYNC_CALLBACKS == true
+      void (*resumeCallback)();
+      uint16_t resumeLine;
+      #endif
+      PollNumber poll;
+      #if SERIALMENU_ENABLE_SEARCH == true
+      Search search;
+      #endif
+      #if SERIALMENU_ENABLE_MACROS == true
+      Macro macro;
+      #endif
+      #if SERIALMENU_ENABLE_ANSI_RENDERER == true
+      AnsiScreen screen;
+      #endif
+    };
+
+    // Start a session on a menu, like a board just reset
+    static void beginSession(Session & session, const SerialMenuEntry * array,
+                             SerialMenuSize arraySize)
+    {
+      session = Session();
+      session.menu = array;
+      session.size = arraySize;
+    }
+
+    static void saveSession(Session & session)
+    {
+      session.menu = menu;
+      session.size = size;
+      session.page = page;
+      #if SERIALMENU_ENABLE_GENERATED_MENUS == true
+      session.generator = generator;
+      session.counter = counter;
+      #endif
+      #if SERIALMENU_ENABLE_ASYNC_CALLBACKS == true
+      session.resumeCallback = resumeCallback;
+      session.resumeLine = resumeLine;
+      #endif
+      session.poll = pollState();
+      #if SERIALMENU_ENABLE_SEARCH == true
+      session.search = search();
+      #endif
+      #if SERIALMENU_ENABLE_MACROS == true
+      session.macro = macro();
+      #endif
+      #if SERIALMENU_ENABLE_ANSI_RENDERER == true
+      session.screen = ansiScreen();
+      #endif
+    }
+
+    // Restore a session as saved, without loading its menu again
+    static void restoreSession(const Session & session)
+    {
+      menu = session.menu;
+      size = session.size;
+      page = session.page;
+      #if SERIALMENU_ENABLE_GENERATED_MENUS == true
+      generator = session.generator;
+      counter = session.counter;
+      #endif
+      #if SERIALMENU_ENABLE_ASYNC_CALLBACKS == true
+      resumeCallback = session.resumeCallback;
+      resumeLine = session.resumeLine;
+      #endif
+      pollState() = session.poll;
+      #if SERIALMENU_ENABLE_SEARCH == true
+      search() = session.search;
+      #endif
+      #if SERIALMENU_ENABLE_MACROS == true
+      macro() = session.macro;
+      #endif
+      #if SERIALMENU_ENABLE_ANSI_RENDERER == true
+      ansiScreen() = session.screen;
+      #endif
+    }
+
+    // Host only: event driven version of run(). The process sleeps in the
+    // kernel until there is user input or a watch to print, then runs the
+    // menu. It returns false without waiting once the input is closed.
+    bool run()
+    {
+      start();
+      int timeoutMs = -1;
+      #if SERIALMENU_ENABLE_WATCHES == true
+      // Wake up when the next watch is due and its budget is earned
+      if (watches.count)
+      {
+        const int16_t dueMs = watches.dueMs - uint16_t(millis());
+        const int32_t budgetMs = -watches.budget / WATCH_BYTES_PER_SECOND;
+        timeoutMs = (dueMs > budgetMs) ? dueMs : budgetMs;
+        timeoutMs = (timeoutMs > 0) ? timeoutMs : 0;
+      }
+      #endif
+      #if SERIALMENU_ENABLE_PERSISTENCE == true
+      // Wake up to save the changes
+      if (isDirty())
+      {
+        const uint16_t idleMs = uint16_t(millis()) - persistState().changedMs;
+        const int saveMs = (idleMs < SERIALMENU_PERSIST_DELAY_MS)
+                         ? SERIALMENU_PERSIST_DELAY_MS - idleMs : 0;
+        timeoutMs = (timeoutMs < 0 || saveMs < timeoutMs) ? saveMs : timeoutMs;
+      }
+      #endif
+      Serial.wait(timeoutMs);
+      return run(1000);
+    }
+    #endif
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Timer1 interrupt blinking the heartbeat LED, see
+// SERIALMENU_ENABLE_TIMER_HEARTBEAT. A program defines an interrupt handler
+// once: write SERIALMENU_TIMER_HEARTBEAT_ISR() in one file of the sketch,
+// outside of any function. On the host it defines nothing.
+///////////////////////////////////////////////////////////////////////////////
+#if SERIALMENU_TIMER_HEARTBEAT == true && !defined(SERIALMENU_TTY)
+#define SERIALMENU_TIMER_HEARTBEAT_ISR() \
+  extern const uint8_t serialMenuTimerInterrupt = _BV(OCIE1A); \
+  ISR(TIMER1_COMPA_vect) \
+  { \
+    SerialMenu::heartbeatTick(); \
+  }
+#else
+#define SERIALMENU_TIMER_HEARTBEAT_ISR()
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// Async callbacks
+//
+// A callback which needs more input, like a number, normally blocks inside
+// getNumber() until the user typed it, and loop() stops meanwhile.
+// Written between SERIALMENU_BEGIN_ASYNC() and SERIALMENU_END_ASYNC(), a
+// callback can instead await its input: if it is not there yet the callback
+// returns to loop(), and run() resumes it where it left once there is input.
+// This requires SERIALMENU_ENABLE_ASYNC_CALLBACKS set to true.
+//
+// These are protothreads: the callback resumes with a switch statement, so
+// local variables are lost when it awaits. Use static or global variables,
+// and put at most one SERIALMENU_AWAIT_*() per source line. Where to resume
+// is kept in the menu's state, so a server saves it with each session.
+//
+// Example, a wizard asking for two values while loop() keeps running:
+// {"W - wizard", false, 'w', [](){
+//   SERIALMENU_BEGIN_ASYNC();
+//   SERIALMENU_AWAIT_NUMBER(uint16_t, x, "x = ");
+//   SERIALMENU_AWAIT_NUMBER(float, f, "f = ");
+//   Serial.println(x * f);
+//   SERIALMENU_END_ASYNC();
+// }}
+///////////////////////////////////////////////////////////////////////////////
+// An await falls through to the case it resumes at, on purpose
+#if defined(__clang__)
+#define SERIALMENU_FALLTHROUGH [[clang::fallthrough]]
+#elif defined(__GNUC__) && __GNUC__ >= 7
+#define SERIALMENU_FALLTHROUGH __attribute__((fallthrough))
+#else
+#define SERIALMENU_FALLTHROUGH
+#endif
+
+#define SERIALMENU_BEGIN_ASYNC() \
+  switch (SerialMenu::asyncLine()) { case 0:
+
+// Wait for a character and store it in c
+#define SERIALMENU_AWAIT_CHAR(c) \
+  SerialMenu::asyncLine() = __LINE__; SERIALMENU_FALLTHROUGH; \
+  case __LINE__: \
+  if (!SerialMenu::pollChar(c)) { SerialMenu::await(); return; }
+
+// Print message and wait for a number of type T, then store it in var
+#define SERIALMENU_AWAIT_NUMBER(T, var, message) \
+  SerialMenu::asyncLine() = __LINE__; SERIALMENU_FALLTHROUGH; \
+  case __LINE__: \
+  if (!SerialMenu::pollNumber<T>(var, message)) { SerialMenu::await(); return; }
+
+#define SERIALMENU_END_ASYNC() \
+  } SerialMenu::asyncLine() = 0
+
+///////////////////////////////////////////////////////////////////////////////
+// Fail the build if printing bytes takes longer than budgetUs microseconds
+// at SERIALMENU_BAUD_RATE. See SerialMenu::showBytes().
+///////////////////////////////////////////////////////////////////////////////
+#define SERIALMENU_ASSERT_SHOW_BUDGET(bytes, budgetUs) \
+  static_assert(SerialMenu::transmitUs(bytes) <= (budgetUs), \
+                "Menu output exceeds its transmit time budget")
+
+#endif
@@ -0,0 +1,8 @@
+///////////////////////////////////////////////////////////////////////////////
+// SerialMenu Unix domain socket server
+// SerialMenu - Copyright (c) 2019 Dan Truong
+// See SerialMenuServer.hpp for details
+///////////////////////////////////////////////////////////////////////////////
+// The server is all in SerialMenuServer.hpp, built with the configuration
+// chosen by the program. This file is kept so that builds listing it still
+// work.
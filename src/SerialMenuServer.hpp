@@ -0,0 +1,319 @@
+///////////////////////////////////////////////////////////////////////////////
+// SerialMenu Unix domain socket server
+// SerialMenu - Copyright (c) 2019 Dan Truong
+// See SerialMenu.hpp for details
+///////////////////////////////////////////////////////////////////////////////
+//
+// Serves the menus to many clients at once on a Linux host, for example test
+// scripts of a hardware in the loop bench. Each connection is a session with
+// its own current menu, as if each client had its own board.
+//
+// The server is a single threaded epoll event loop. When a client sends keys,
+// Serial is attached to that client's buffers, the client's session is
+// restored, and run() dispatches every key received. The output of all these
+// callbacks is sent back with a single write(). A session is the whole state
+// of the menu for a client, see SerialMenu::Session: its current menu, and
+// any input in progress, like an async callback waiting or a search.
+//
+// Callbacks that block waiting for more input, like getNumber(), wait on
+// their own client only, and hold the other sessions meanwhile. They give up
+// after waitLimitMs without input, as if the client had left, and get their
+// default value. Use async callbacks to wait without holding anyone, see
+// SERIALMENU_ENABLE_ASYNC_CALLBACKS.
+//
+// The server is all in this header, so that it is built with the
+// configuration of the program, like SerialMenu.hpp. Include it after the
+// SERIALMENU_* options are defined.
+//
+/////////////////
+// Usage example:
+/////////////////
+// int main()
+// {
+//   SerialMenuServer server;
+//   if (!server.begin("/tmp/menu.sock", mainMenu, mainMenuSize)) return 1;
+//   while (server.run());
+// }
+//
+// Then connect with "socat - UNIX-CONNECT:/tmp/menu.sock".
+// See extras/linux/server_bench.cpp for a load generator.
+///////////////////////////////////////////////////////////////////////////////
+#ifndef SERIALMENU_SERVER
+#define SERIALMENU_SERVER true
+
+#include "SerialMenu.hpp"
+
+#include <errno.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+class SerialMenuServer
+{
+  private:
+    // Events handled per epoll_wait() call
+    static constexpr int MAX_EVENTS = 32;
+
+    // State of one client connection
+    struct Session
+    {
+      int fd;
+      SerialMenu::Session state;
+      SerialMenuChannel channel;
+    };
+
+    int listenFd;
+    int epollFd;
+    // Session pool, a free session has fd -1
+    Session * sessions;
+    const uint16_t maxSessions;
+    uint16_t activeSessions;
+    uint32_t commands;
+    const int waitLimitMs;
+    // Menu new sessions start on
+    const SerialMenuEntry * rootMenu;
+    SerialMenuSize rootSize;
+
+    void accept();
+    void serve(Session & session);
+    void close(Session & session);
+
+  public:
+    // A callback waiting for input more than waitLimitMs (-1 for no limit)
+    // gives up, so one client can't hold the others for longer
+    SerialMenuServer(uint16_t maxSessions = 64, int waitLimitMs = 1000);
+    ~SerialMenuServer();
+
+    // Listen on the Unix domain socket path. New sessions start on menu and
+    // get it shown, like setup() does on a board.
+    bool begin(const char * path,
+               const SerialMenuEntry * menu, SerialMenuSize menuSize);
+    // Wait up to timeoutMs (-1 forever) for events and serve them.
+    // Returns false if the server is not running.
+    bool run(int timeoutMs = -1);
+    // Close all sessions and stop listening
+    void end();
+
+    // Number of connected clients
+    inline uint16_t getSessions() const
+    {
+      return activeSessions;
+    }
+    // Number of keys dispatched to menus since begin()
+    inline uint32_t getCommands() const
+    {
+      return commands;
+    }
+};
+
+inline SerialMenuServer::SerialMenuServer(uint16_t maxSessions,
+                                          int waitLimitMs) :
+  listenFd(-1),
+  epollFd(-1),
+  sessions(new Session[maxSessions]),
+  maxSessions(maxSessions),
+  activeSessions(0),
+  commands(0),
+  waitLimitMs(waitLimitMs),
+  rootMenu(nullptr),
+  rootSize(0)
+{
+  for (uint16_t i = 0; i < maxSessions; ++i)
+  {
+    sessions[i].fd = -1;
+  }
+}
+
+inline SerialMenuServer::~SerialMenuServer()
+{
+  end();
+  delete[] sessions;
+}
+
+inline bool SerialMenuServer::begin(const char * path,
+                                    const SerialMenuEntry * menu,
+                                    SerialMenuSize menuSize)
+{
+  struct sockaddr_un addr;
+  if (strlen(path) >= sizeof(addr.sun_path))
+  {
+    return false;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  rootMenu = menu;
+  rootSize = menuSize;
+  // Writing to a client that left must fail, not kill the server
+  signal(SIGPIPE, SIG_IGN);
+  // Set up the menu now, it prints on the console
+  SerialMenu::begin();
+
+  listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  epollFd = epoll_create1(EPOLL_CLOEXEC);
+  if (listenFd < 0 || epollFd < 0)
+  {
+    end();
+    return false;
+  }
+
+  // Replace the socket of a previous run
+  unlink(path);
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.ptr = nullptr;
+  if (bind(listenFd, (struct sockaddr *) &addr, sizeof(addr)) != 0 ||
+      ::listen(listenFd, SOMAXCONN) != 0 ||
+      epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &ev) != 0)
+  {
+    end();
+    return false;
+  }
+  return true;
+}
+
+inline void SerialMenuServer::end()
+{
+  for (uint16_t i = 0; i < maxSessions; ++i)
+  {
+    if (sessions[i].fd >= 0)
+    {
+      close(sessions[i]);
+    }
+  }
+  if (listenFd >= 0)
+  {
+    ::close(listenFd);
+    listenFd = -1;
+  }
+  if (epollFd >= 0)
+  {
+    ::close(epollFd);
+    epollFd = -1;
+  }
+}
+
+inline bool SerialMenuServer::run(int timeoutMs)
+{
+  if (epollFd < 0)
+  {
+    return false;
+  }
+
+  struct epoll_event events[MAX_EVENTS];
+  const int n = epoll_wait(epollFd, events, MAX_EVENTS, timeoutMs);
+  if (n < 0)
+  {
+    return errno == EINTR;
+  }
+
+  for (int i = 0; i < n; ++i)
+  {
+    Session * session = (Session *) events[i].data.ptr;
+    if (!session)
+    {
+      accept();
+    }
+    else if (session->fd >= 0)
+    {
+      // A hang up may come with the last keys, serve them first
+      serve(*session);
+    }
+  }
+  return true;
+}
+
+inline void SerialMenuServer::accept()
+{
+  for (;;)
+  {
+    const int fd = accept4(listenFd, nullptr, nullptr,
+                           SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0)
+    {
+      return;
+    }
+
+    Session * session = nullptr;
+    for (uint16_t i = 0; i < maxSessions && !session; ++i)
+    {
+      if (sessions[i].fd < 0)
+      {
+        session = &sessions[i];
+      }
+    }
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.ptr = session;
+    if (!session || epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) != 0)
+    {
+      // Server full
+      ::close(fd);
+      continue;
+    }
+
+    session->fd = fd;
+    session->channel = SerialMenuChannel(fd, fd);
+    session->channel.waitLimitMs = waitLimitMs;
+    SerialMenu::beginSession(session->state, rootMenu, rootSize);
+    ++activeSessions;
+
+    // Greet the new client with its menu
+    SerialMenu & menu = SerialMenu::get();
+    Serial.attach(&session->channel);
+    menu.restoreSession(session->state);
+    menu.show();
+    Serial.flush();
+    menu.saveSession(session->state);
+    Serial.attach(nullptr);
+  }
+}
+
+inline void SerialMenuServer::serve(Session & session)
+{
+  SerialMenu & menu = SerialMenu::get();
+  SerialMenuChannel & channel = session.channel;
+
+  // Switch the menu to this client's session
+  Serial.attach(&channel);
+  menu.restoreSession(session.state);
+  channel.stalled = false;
+  channel.waitedMs = 0;
+
+  // Read what the client sent once, and dispatch all of it. The output is
+  // batched and sent once at the end.
+  if (Serial.available())
+  {
+    while (channel.rxHead != channel.rxTail)
+    {
+      if (menu.run(1000))
+      {
+        ++commands;
+      }
+    }
+  }
+  Serial.flush();
+
+  // Save the session, callbacks may have loaded another menu
+  menu.saveSession(session.state);
+  Serial.attach(nullptr);
+
+  if (channel.closed)
+  {
+    close(session);
+  }
+}
+
+inline void SerialMenuServer::close(Session & session)
+{
+  epoll_ctl(epollFd, EPOLL_CTL_DEL, session.fd, nullptr);
+  ::close(session.fd);
+  session.fd = -1;
+  --activeSessions;
+}
+
+#endif
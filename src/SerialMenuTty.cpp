@@ -0,0 +1,439 @@
+///////////////////////////////////////////////////////////////////////////////
+// SerialMenu Linux tty backend
+// SerialMenu - Copyright (c) 2019 Dan Truong
+// See SerialMenuTty.hpp for details
+///////////////////////////////////////////////////////////////////////////////
+// The Arduino IDE compiles every file of the library, so on boards this file
+// must compile to nothing.
+#if !defined(ARDUINO) && defined(__linux__)
+#include "SerialMenuTty.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+// The Serial console object used by the menus
+SerialMenuTtySerial Serial;
+// EEPROM, erased until a file is opened
+SerialMenuTtyEeprom EEPROM;
+// Mock timer
+SerialMenuTtyTimer Timer1;
+
+// Terminal settings to restore at exit
+static int ttyFd = -1;
+static struct termios ttySaved;
+
+static void restoreTty()
+{
+  Serial.attach(nullptr);
+  Serial.end();
+}
+
+// Killed by a signal, e.g. Ctrl-C: restore the terminal, then die as asked
+static void restoreTtyOnSignal(int sig)
+{
+  if (ttyFd >= 0)
+  {
+    tcsetattr(ttyFd, TCSAFLUSH, &ttySaved);
+  }
+  signal(sig, SIG_DFL);
+  raise(sig);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Arduino timing and utility functions
+///////////////////////////////////////////////////////////////////////////////
+static uint64_t nowUs()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return uint64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Time 0 is the first time the program asks, close to the start like on a
+// board.
+static uint64_t elapsedUs()
+{
+  static const uint64_t startUs = nowUs();
+  return nowUs() - startUs;
+}
+
+unsigned long millis()
+{
+  return elapsedUs() / 1000;
+}
+
+unsigned long micros()
+{
+  return elapsedUs();
+}
+
+void delay(unsigned long ms)
+{
+  // The program is going to sleep, show the user what it printed so far
+  Serial.flush();
+  struct timespec ts;
+  ts.tv_sec = ms / 1000;
+  ts.tv_nsec = (ms % 1000) * 1000000L;
+  while (nanosleep(&ts, &ts) == -1 && errno == EINTR);
+}
+
+long random(long howBig)
+{
+  return howBig ? ::random() % howBig : 0;
+}
+
+long random(long howSmall, long howBig)
+{
+  return (howSmall < howBig) ? howSmall + random(howBig - howSmall) : howSmall;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Serial console
+///////////////////////////////////////////////////////////////////////////////
+bool SerialMenuTtySerial::open(const char * path)
+{
+  const int fd = ::open(path, O_RDWR | O_NOCTTY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    return false;
+  }
+  console.inFd = fd;
+  console.outFd = fd;
+  console.closed = false;
+  return true;
+}
+
+static speed_t toSpeed(unsigned long baud)
+{
+  switch (baud)
+  {
+    case 1200:   return B1200;
+    case 2400:   return B2400;
+    case 4800:   return B4800;
+    case 19200:  return B19200;
+    case 38400:  return B38400;
+    case 57600:  return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+    case 460800: return B460800;
+    case 921600: return B921600;
+    default:     return B9600;
+  }
+}
+
+void SerialMenuTtySerial::begin(unsigned long baud)
+{
+  // Send what is left in the buffer when the program exits
+  static bool atexitDone = false;
+  if (!atexitDone)
+  {
+    atexit(restoreTty);
+    atexitDone = true;
+  }
+
+  const int fd = console.inFd;
+  if (ttyFd >= 0 || !isatty(fd) || tcgetattr(fd, &ttySaved) != 0)
+  {
+    // Already set up, or a pipe or file that needs no setup
+    return;
+  }
+
+  // Raw mode: no line editing, no echo, 8 bit clean. Keep Ctrl-C working
+  // and map the Enter key's carriage return to the newline the Arduino
+  // console sends.
+  struct termios raw = ttySaved;
+  raw.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | IXON);
+  raw.c_iflag |= ICRNL;
+  raw.c_lflag &= ~(ECHO | ECHONL | ICANON | IEXTEN);
+  raw.c_cflag &= ~(CSIZE | PARENB);
+  raw.c_cflag |= CS8;
+  raw.c_cc[VMIN] = 1;
+  raw.c_cc[VTIME] = 0;
+
+  // A serial device opened by the program gets the output as is and the baud
+  // rate. A terminal keeps its output processing, so menu lines ending with
+  // a bare "\n" still start at the left margin.
+  if (fd != STDIN_FILENO)
+  {
+    raw.c_oflag &= ~OPOST;
+    raw.c_cflag |= CLOCAL | CREAD;
+    cfsetispeed(&raw, toSpeed(baud));
+    cfsetospeed(&raw, toSpeed(baud));
+  }
+
+  if (tcsetattr(fd, TCSAFLUSH, &raw) == 0)
+  {
+    ttyFd = fd;
+    signal(SIGINT, restoreTtyOnSignal);
+    signal(SIGTERM, restoreTtyOnSignal);
+    signal(SIGHUP, restoreTtyOnSignal);
+  }
+}
+
+void SerialMenuTtySerial::end()
+{
+  flush();
+  if (ttyFd >= 0)
+  {
+    tcsetattr(ttyFd, TCSAFLUSH, &ttySaved);
+    ttyFd = -1;
+  }
+}
+
+int SerialMenuTtySerial::fill()
+{
+  SerialMenuChannel & c = *channel;
+
+  // Nothing to read: good time to show what was printed so far
+  if (c.txLen)
+  {
+    flush();
+  }
+  if (c.closed)
+  {
+    return 0;
+  }
+
+  struct pollfd pfd = { c.inFd, POLLIN, 0 };
+  if (poll(&pfd, 1, 0) <= 0)
+  {
+    return 0;
+  }
+
+  c.rxHead = c.rxTail = 0;
+  const ssize_t n = ::read(c.inFd, c.rx, SerialMenuChannel::RX_BUF_SIZE);
+  if (n > 0)
+  {
+    c.rxTail = n;
+    c.waitedMs = 0;
+  }
+  else if (n == 0 || (errno != EAGAIN && errno != EINTR))
+  {
+    // End of file or hang up
+    c.closed = true;
+  }
+  return c.rxTail;
+}
+
+bool SerialMenuTtySerial::wait(int timeoutMs)
+{
+  SerialMenuChannel & c = *channel;
+
+  flush();
+  if (c.rxTail != c.rxHead)
+  {
+    return true;
+  }
+
+  // Waiting for input longer than the limit stalls the channel
+  bool limited = false;
+  if (c.waitLimitMs >= 0)
+  {
+    const uint32_t left = c.waitedMs < uint32_t(c.waitLimitMs) ?
+                          c.waitLimitMs - c.waitedMs : 0;
+    if (timeoutMs < 0 || uint32_t(timeoutMs) >= left)
+    {
+      timeoutMs = left;
+      limited = true;
+    }
+  }
+
+  while (!c.closed && !c.stalled)
+  {
+    const unsigned long startMs = millis();
+    struct pollfd pfd = { c.inFd, POLLIN, 0 };
+    const int ready = poll(&pfd, 1, timeoutMs);
+    if (ready > 0)
+    {
+      // Reading also detects the end of file
+      return fill();
+    }
+    c.waitedMs += millis() - startMs;
+    if (ready == 0 && limited)
+    {
+      c.stalled = true;
+    }
+    if (ready == 0 || errno != EINTR)
+    {
+      break;
+    }
+  }
+  return false;
+}
+
+void SerialMenuTtySerial::flush()
+{
+  SerialMenuChannel & c = *channel;
+  uint16_t sent = 0;
+
+  while (sent < c.txLen)
+  {
+    const ssize_t n = ::write(c.outFd, c.tx + sent, c.txLen - sent);
+    if (n > 0)
+    {
+      sent += n;
+    }
+    else if (n < 0 && errno == EAGAIN)
+    {
+      // Non-blocking descriptor: sleep until the kernel can take more
+      struct pollfd pfd = { c.outFd, POLLOUT, 0 };
+      poll(&pfd, 1, -1);
+    }
+    else if (n == 0 || errno != EINTR)
+    {
+      // The peer is gone, drop the output
+      c.closed = true;
+      break;
+    }
+  }
+  c.txLen = 0;
+}
+
+size_t SerialMenuTtySerial::write(const char * s, size_t n)
+{
+  SerialMenuChannel & c = *channel;
+
+  for (size_t left = n; left;)
+  {
+    if (c.txLen == SerialMenuChannel::TX_BUF_SIZE)
+    {
+      flush();
+    }
+    size_t chunk = SerialMenuChannel::TX_BUF_SIZE - c.txLen;
+    if (chunk > left)
+    {
+      chunk = left;
+    }
+    memcpy(c.tx + c.txLen, s, chunk);
+    c.txLen += chunk;
+    s += chunk;
+    left -= chunk;
+  }
+  return n;
+}
+
+size_t SerialMenuTtySerial::printNumber(unsigned long n, uint8_t base)
+{
+  char buffer[8 * sizeof(long) + 1];
+  char * str = &buffer[sizeof(buffer)];
+
+  if (base < 2)
+  {
+    base = 10;
+  }
+  do
+  {
+    const char digit = n % base;
+    *--str = digit < 10 ? digit + '0' : digit + 'A' - 10;
+    n /= base;
+  } while (n);
+
+  return write(str, &buffer[sizeof(buffer)] - str);
+}
+
+// Same output as the Arduino core's Print::printFloat()
+size_t SerialMenuTtySerial::printFloat(double number, uint8_t digits)
+{
+  size_t n = 0;
+
+  if (number != number) return print("nan");
+  if (number > 4294967040.0 || number < -4294967040.0) return print("ovf");
+
+  if (number < 0.0)
+  {
+    n += write('-');
+    number = -number;
+  }
+
+  // Round correctly so that print(1.999, 2) prints as "2.00"
+  double rounding = 0.5;
+  for (uint8_t i = 0; i < digits; ++i)
+  {
+    rounding /= 10.0;
+  }
+  number += rounding;
+
+  unsigned long intPart = (unsigned long) number;
+  double remainder = number - (double) intPart;
+  n += printNumber(intPart, 10);
+
+  if (digits > 0)
+  {
+    n += write('.');
+  }
+  while (digits-- > 0)
+  {
+    remainder *= 10.0;
+    const unsigned int digit = (unsigned int) remainder;
+    n += write(char('0' + digit));
+    remainder -= digit;
+  }
+  return n;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// EEPROM
+///////////////////////////////////////////////////////////////////////////////
+bool SerialMenuTtyEeprom::open(const char * path)
+{
+  const int f = ::open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (f < 0)
+  {
+    return false;
+  }
+
+  // Bytes past the end of the file are erased, and the file is extended
+  // with them so that writes never leave holes reading back as 0
+  uint8_t buffer[SIZE];
+  ssize_t n = pread(f, buffer, SIZE, 0);
+  n = (n < 0) ? 0 : n;
+  memset(buffer + n, 0xFF, SIZE - n);
+  if (n < SIZE && pwrite(f, buffer + n, SIZE - n, n) != SIZE - n)
+  {
+    close(f);
+    return false;
+  }
+  for (uint16_t i = 0; i < SIZE; ++i)
+  {
+    data[i] = buffer[i] ^ 0xFF;
+  }
+
+  if (fd >= 0)
+  {
+    close(fd);
+  }
+  fd = f;
+  return true;
+}
+
+void SerialMenuTtyEeprom::write(int address, uint8_t value)
+{
+  data[address] = value ^ 0xFF;
+  if (fd >= 0)
+  {
+    // Write through, like the real thing: a crash loses nothing written
+    pwrite(fd, &value, 1, address);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Mock timer
+///////////////////////////////////////////////////////////////////////////////
+void SerialMenuTtyTimer::elapse(uint32_t ms)
+{
+  phaseMs += ms;
+  // The handler may stop the timer
+  while (handler && phaseMs >= periodMs)
+  {
+    phaseMs -= periodMs;
+    handler();
+  }
+}
+
+#endif
@@ -0,0 +1,392 @@
+///////////////////////////////////////////////////////////////////////////////
+// SerialMenu Linux tty backend
+// SerialMenu - Copyright (c) 2019 Dan Truong
+// See SerialMenu.hpp for details
+///////////////////////////////////////////////////////////////////////////////
+//
+// This backend lets the very same SerialMenuEntry tables run in a Linux
+// program, for example a test fixture or a gateway daemon, instead of on an
+// Arduino board. SerialMenu.hpp includes it automatically when ARDUINO is not
+// defined.
+//
+// It provides the few pieces of the Arduino core the library uses:
+// * PROGMEM and its accessors, which simply read regular memory
+// * millis(), micros(), delay() and random()
+// * A Serial object reading and writing a file descriptor
+// * An EEPROM object, kept in memory or in a file, see EEPROM.open()
+// * A mock hardware timer, Timer1, for tests
+//
+// By default Serial uses stdin and stdout. Call Serial.open() before creating
+// the menu to use a serial device instead, for example "/dev/ttyUSB0".
+// When the input is a terminal it is switched to termios raw mode, so each
+// key press is seen as soon as it is typed, like on the Arduino console.
+// The terminal settings are restored when the program exits.
+//
+// Input is polled with poll() and never blocks unless asked to. Output is
+// buffered and written with write() when the buffer is full, when the code
+// looks for input and finds none, or before sleeping.
+//
+// Instead of calling run(loopDelayMs) from a busy loop, a host program can
+// call run() without argument. It sleeps in the kernel until there is input.
+//
+/////////////////
+// Usage example:
+/////////////////
+// Compile the sketch as a C++ file along with SerialMenu.cpp and
+// SerialMenuTty.cpp, then provide main():
+//
+// int main(int argc, char ** argv)
+// {
+//   if (argc > 1 && !Serial.open(argv[1])) return 1;
+//   setup();
+//   while (Serial)
+//   {
+//     menu.run();
+//   }
+//   return 0;
+// }
+//
+// See extras/linux/tty_demo.cpp for a full program.
+///////////////////////////////////////////////////////////////////////////////
+#ifndef SERIALMENU_TTY
+#define SERIALMENU_TTY true
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Flash memory does not exist on the host, PROGMEM data is regular data.
+///////////////////////////////////////////////////////////////////////////////
+#define PROGMEM
+#define PSTR(s) (s)
+#define F(s) (s)
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_ptr(addr) (*(const void * const *)(addr))
+
+inline size_t strlen_P(const char * s)
+{
+  return strlen(s);
+}
+
+inline void * memcpy_P(void * dst, const void * src, size_t n)
+{
+  return memcpy(dst, src, n);
+}
+
+// strlcpy() is not in all C libraries, so implement the _P variant here
+inline size_t strlcpy_P(char * dst, const char * src, size_t size)
+{
+  const size_t len = strlen(src);
+  if (size)
+  {
+    const size_t n = (len >= size) ? size - 1 : len;
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+  }
+  return len;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Arduino timing and utility functions
+///////////////////////////////////////////////////////////////////////////////
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+long random(long howBig);
+long random(long howSmall, long howBig);
+
+// Size of the receive buffer, named like HardwareSerial.h names it
+#define SERIAL_RX_BUFFER_SIZE 256
+
+///////////////////////////////////////////////////////////////////////////////
+// Input and output buffers of one connection.
+// Serial works on one channel at a time. The default channel is stdin and
+// stdout, a server can attach Serial to the channel of the client it serves.
+///////////////////////////////////////////////////////////////////////////////
+struct SerialMenuChannel
+{
+  static constexpr uint16_t RX_BUF_SIZE = SERIAL_RX_BUFFER_SIZE;
+  static constexpr uint16_t TX_BUF_SIZE = 512;
+
+  // File descriptors to read from and write to
+  int inFd;
+  int outFd;
+  // Set once the input reached end of file or the peer hung up
+  bool closed;
+  // Longest wait for input in ms, -1 for none, and the time waited since
+  // the last input. Once reads waited longer they give up and set stalled,
+  // which reads like a closed input until cleared.
+  int waitLimitMs;
+  uint32_t waitedMs;
+  bool stalled;
+  // Received bytes not read yet are rx[rxHead..rxTail[
+  uint16_t rxHead;
+  uint16_t rxTail;
+  uint8_t rx[RX_BUF_SIZE];
+  // Bytes written but not sent yet
+  uint16_t txLen;
+  char tx[TX_BUF_SIZE];
+
+  constexpr SerialMenuChannel(int in = 0, int out = 1) :
+    inFd(in),
+    outFd(out),
+    closed(false),
+    waitLimitMs(-1),
+    waitedMs(0),
+    stalled(false),
+    rxHead(0),
+    rxTail(0),
+    rx(),
+    txLen(0),
+    tx()
+  {}
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Serial console on a file descriptor, with the subset of the Arduino
+// HardwareSerial interface that menus use.
+///////////////////////////////////////////////////////////////////////////////
+class SerialMenuTtySerial
+{
+  private:
+    // The channel in use, and the default stdin/stdout one
+    SerialMenuChannel * channel;
+    SerialMenuChannel console;
+
+    // Read what the kernel has without blocking. Returns bytes buffered.
+    int fill();
+    size_t printNumber(unsigned long n, uint8_t base);
+    size_t printFloat(double n, uint8_t digits);
+
+  public:
+    // Constant initialized, so it is usable by other global constructors,
+    // like a menu created with SerialMenu::get() at global scope.
+    constexpr SerialMenuTtySerial() :
+      channel(&console),
+      console()
+    {}
+
+    // Use a serial device instead of stdin/stdout. Call before begin().
+    bool open(const char * path);
+    // Prepare the input for raw key presses, and the device's baud rate
+    void begin(unsigned long baud);
+    // Send pending output and restore the terminal settings
+    void end();
+
+    // Work on another connection's buffers, or back on the console if null
+    inline void attach(SerialMenuChannel * c)
+    {
+      channel = c ? c : &console;
+    }
+    inline SerialMenuChannel & getChannel()
+    {
+      return *channel;
+    }
+
+    // False once the input is closed, so a program can loop while (Serial),
+    // or while it is stalled past its wait limit
+    inline operator bool() const
+    {
+      return !channel->closed && !channel->stalled;
+    }
+
+    // Number of bytes that can be read without blocking
+    inline int available()
+    {
+      const int n = channel->rxTail - channel->rxHead;
+      return n ? n : fill();
+    }
+    // Read one byte, or -1 if there is none
+    inline int read()
+    {
+      if (!available())
+      {
+        return -1;
+      }
+      return channel->rx[channel->rxHead++];
+    }
+    inline int peek()
+    {
+      return available() ? channel->rx[channel->rxHead] : -1;
+    }
+
+    // Send pending output, then sleep until there is input or timeoutMs
+    // elapsed (-1 waits forever), within the channel's wait limit.
+    // Returns true if input is available.
+    bool wait(int timeoutMs);
+    // Send pending output, blocking until the kernel took it all
+    void flush();
+
+    inline size_t write(uint8_t c)
+    {
+      if (channel->txLen == SerialMenuChannel::TX_BUF_SIZE)
+      {
+        flush();
+      }
+      channel->tx[channel->txLen++] = c;
+      return 1;
+    }
+    size_t write(const char * s, size_t n);
+
+    inline size_t print(const char * s)
+    {
+      return s ? write(s, strlen(s)) : 0;
+    }
+    inline size_t print(char c)
+    {
+      return write(uint8_t(c));
+    }
+    inline size_t print(unsigned long n, int base = 10)
+    {
+      return printNumber(n, base);
+    }
+    inline size_t print(long n, int base = 10)
+    {
+      if (n < 0 && base == 10)
+      {
+        return write('-') + printNumber(-(unsigned long) n, base);
+      }
+      return printNumber(n, base);
+    }
+    inline size_t print(unsigned char n, int base = 10)
+    {
+      return print((unsigned long) n, base);
+    }
+    inline size_t print(unsigned int n, int base = 10)
+    {
+      return print((unsigned long) n, base);
+    }
+    inline size_t print(int n, int base = 10)
+    {
+      return print((long) n, base);
+    }
+    inline size_t print(double n, int digits = 2)
+    {
+      return printFloat(n, digits);
+    }
+
+    inline size_t println()
+    {
+      return write("\r\n", 2);
+    }
+    template <class T>
+    inline size_t println(T value)
+    {
+      return print(value) + println();
+    }
+    template <class T>
+    inline size_t println(T value, int format)
+    {
+      return print(value, format) + println();
+    }
+};
+
+extern SerialMenuTtySerial Serial;
+
+///////////////////////////////////////////////////////////////////////////////
+// EEPROM with the interface of the Arduino EEPROM library, the size of an
+// ATmega328P's. It is kept in memory, or in a file to survive restarts.
+///////////////////////////////////////////////////////////////////////////////
+class SerialMenuTtyEeprom
+{
+  public:
+    static constexpr uint16_t SIZE = 1024;
+
+  private:
+    // Stored inverted, so that the zero initialized array reads erased (0xFF)
+    uint8_t data[SIZE];
+    // File keeping the content, if any
+    int fd;
+
+  public:
+    constexpr SerialMenuTtyEeprom() :
+      data(),
+      fd(-1)
+    {}
+
+    // Keep the content in a file, created if needed. Call before using it.
+    bool open(const char * path);
+
+    inline uint8_t read(int address) const
+    {
+      return data[address] ^ 0xFF;
+    }
+    void write(int address, uint8_t value);
+    // Write only if the value changed, like on a board to save wear
+    inline void update(int address, uint8_t value)
+    {
+      if (read(address) != value)
+      {
+        write(address, value);
+      }
+    }
+    inline uint16_t length() const
+    {
+      return SIZE;
+    }
+};
+
+extern SerialMenuTtyEeprom EEPROM;
+
+///////////////////////////////////////////////////////////////////////////////
+// Hardware timer stand-in for tests. It calls its interrupt handler once per
+// period, as a test tells it that time elapsed: nothing happens by itself.
+// It also holds a mock LED for the handler to blink.
+///////////////////////////////////////////////////////////////////////////////
+class SerialMenuTtyTimer
+{
+  private:
+    void (*handler)();
+    uint32_t periodMs;
+    // Time elapsed since the last interrupt
+    uint32_t phaseMs;
+    bool led;
+    uint32_t ledChanges;
+
+  public:
+    constexpr SerialMenuTtyTimer() :
+      handler(nullptr),
+      periodMs(0),
+      phaseMs(0),
+      led(false),
+      ledChanges(0)
+    {}
+
+    inline void start(uint32_t ms, void (*f)())
+    {
+      handler = f;
+      periodMs = ms;
+      phaseMs = 0;
+    }
+    inline void stop()
+    {
+      handler = nullptr;
+    }
+    inline bool isRunning() const
+    {
+      return handler != nullptr;
+    }
+
+    // Let ms pass, calling the handler for each period elapsed
+    void elapse(uint32_t ms);
+
+    inline void setLed(bool on)
+    {
+      ledChanges += (on != led);
+      led = on;
+    }
+    inline bool isLedOn() const
+    {
+      return led;
+    }
+    // Number of times the LED was switched on or off
+    inline uint32_t getLedChanges() const
+    {
+      return ledChanges;
+    }
+};
+
+extern SerialMenuTtyTimer Timer1;
+
+#endif